@@ -0,0 +1,190 @@
+#include "Culling.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define CULLING_SSE
+#include <emmintrin.h>
+#endif
+
+BoundingBox BoundingBox::Transformed(const glm::mat4& transform) const {
+    glm::vec3 center = glm::vec3(transform * glm::vec4(Center(), 1));
+    glm::vec3 extent = Extent();
+    // Each world axis picks up the absolute contribution of every local axis
+    glm::vec3 worldExtent(0);
+    for (int axis=0; axis<3; axis++) {
+        worldExtent += glm::abs(glm::vec3(transform[axis])) * extent[axis];
+    }
+    BoundingBox box;
+    box.Min = center - worldExtent;
+    box.Max = center + worldExtent;
+    return box;
+}
+
+BoundingSphere BoundingSphere::Transformed(const glm::mat4& transform) const {
+    BoundingSphere sphere;
+    sphere.Center = glm::vec3(transform * glm::vec4(Center, 1));
+    float scale = glm::max(glm::length(glm::vec3(transform[0])),
+        glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+    sphere.Radius = Radius * scale;
+    return sphere;
+}
+
+void CalculateBounds(const glm::vec3* positions, size_t count, size_t stride, BoundingBox& box, BoundingSphere& sphere) {
+    box = BoundingBox();
+    sphere = BoundingSphere();
+    if (count == 0) return;
+
+    auto position = [&](size_t i) -> const glm::vec3& {
+        return *(const glm::vec3*)((const char*)positions + i * stride);
+    };
+    box.Min = box.Max = position(0);
+    for (size_t i=1; i<count; i++) {
+        box.Min = glm::min(box.Min, position(i));
+        box.Max = glm::max(box.Max, position(i));
+    }
+    sphere.Center = box.Center();
+    float radiusSq = 0;
+    for (size_t i=0; i<count; i++) {
+        glm::vec3 offset = position(i) - sphere.Center;
+        radiusSq = glm::max(radiusSq, glm::dot(offset, offset));
+    }
+    sphere.Radius = std::sqrt(radiusSq);
+}
+
+void Frustum::Extract(const glm::mat4& m) {
+    // Gribb/Hartmann: each plane is the fourth row plus or minus one of the others
+    for (int i=0; i<3; i++) {
+        glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]);
+        glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+        Planes[i * 2] = w + row;
+        Planes[i * 2 + 1] = w - row;
+    }
+    for (auto& plane : Planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+bool Frustum::TestSphere(const BoundingSphere& sphere) const {
+    for (auto& plane : Planes) {
+        if (glm::dot(glm::vec3(plane), sphere.Center) + plane.w < -sphere.Radius)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::TestBox(const BoundingBox& box) const {
+    glm::vec3 center = box.Center();
+    glm::vec3 extent = box.Extent();
+    for (auto& plane : Planes) {
+        glm::vec3 normal(plane);
+        float reach = glm::dot(glm::abs(normal), extent);
+        if (glm::dot(normal, center) + plane.w < -reach)
+            return false;
+    }
+    return true;
+}
+
+size_t Frustum::TestSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count, uint8_t* visible) const {
+    size_t visibleCount = 0;
+    size_t i = 0;
+#ifdef CULLING_SSE
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p=0; p<6; p++) {
+        planeX[p] = _mm_set1_ps(Planes[p].x);
+        planeY[p] = _mm_set1_ps(Planes[p].y);
+        planeZ[p] = _mm_set1_ps(Planes[p].z);
+        planeW[p] = _mm_set1_ps(Planes[p].w);
+    }
+    for (; i + 4 <= count; i += 4) {
+        __m128 sx = _mm_loadu_ps(x + i);
+        __m128 sy = _mm_loadu_ps(y + i);
+        __m128 sz = _mm_loadu_ps(z + i);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p=0; p<6; p++) {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(sx, planeX[p]), _mm_mul_ps(sy, planeY[p])),
+                _mm_add_ps(_mm_mul_ps(sz, planeZ[p]), planeW[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+        int mask = _mm_movemask_ps(inside);
+        for (int lane=0; lane<4; lane++) {
+            visible[i + lane] = (mask >> lane) & 1;
+            visibleCount += visible[i + lane];
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        BoundingSphere sphere;
+        sphere.Center = glm::vec3(x[i], y[i], z[i]);
+        sphere.Radius = radius[i];
+        visible[i] = TestSphere(sphere) ? 1 : 0;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
+
+void Culler::Begin(const glm::mat4& projView) {
+    View.Extract(projView);
+    x.clear();
+    y.clear();
+    z.clear();
+    radius.clear();
+    FrameStats = Stats{};
+}
+
+GLuint Culler::Add(const BoundingSphere& sphere) {
+    x.push_back(sphere.Center.x);
+    y.push_back(sphere.Center.y);
+    z.push_back(sphere.Center.z);
+    radius.push_back(sphere.Radius);
+    return (GLuint)x.size() - 1;
+}
+
+void Culler::Resize(size_t count) {
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    radius.resize(count);
+}
+
+void Culler::Set(GLuint index, const BoundingSphere& sphere) {
+    x[index] = sphere.Center.x;
+    y[index] = sphere.Center.y;
+    z[index] = sphere.Center.z;
+    radius[index] = sphere.Radius;
+}
+
+void Culler::Run() {
+    visible.resize(x.size());
+    if (x.empty()) return;
+    size_t visibleCount = View.TestSpheres(&x[0], &y[0], &z[0], &radius[0], x.size(), &visible[0]);
+    FrameStats.Tested = (GLuint)x.size();
+    FrameStats.Visible = (GLuint)visibleCount;
+    FrameStats.Culled = FrameStats.Tested - FrameStats.Visible;
+}
+
+void Culler::Run(JobSystem& jobs) {
+    visible.resize(x.size());
+    if (x.empty()) return;
+    // A multiple of four so every chunk but the last runs whole SSE batches
+    const size_t CHUNK = 1024;
+    std::atomic<size_t> visibleCount(0);
+    jobs.ParallelFor(x.size(), CHUNK, [&](size_t begin, size_t end) {
+        visibleCount += View.TestSpheres(&x[begin], &y[begin], &z[begin], &radius[begin], end - begin, &visible[begin]);
+    });
+    FrameStats.Tested = (GLuint)x.size();
+    FrameStats.Visible = (GLuint)visibleCount.load();
+    FrameStats.Culled = FrameStats.Tested - FrameStats.Visible;
+}
+
+bool Culler::TestBox(const BoundingBox& box) {
+    FrameStats.MeshesTested++;
+    if (View.TestBox(box))
+        return true;
+    FrameStats.MeshesCulled++;
+    return false;
+}
\ No newline at end of file
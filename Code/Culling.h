@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+class JobSystem;
+
+struct BoundingBox {
+    glm::vec3 Min = glm::vec3(0);
+    glm::vec3 Max = glm::vec3(0);
+
+    glm::vec3 Center() const { return (Min + Max) * 0.5f; }
+    glm::vec3 Extent() const { return (Max - Min) * 0.5f; }
+    // Box around this box after transforming it
+    BoundingBox Transformed(const glm::mat4& transform) const;
+};
+
+struct BoundingSphere {
+    glm::vec3 Center = glm::vec3(0);
+    float Radius = 0;
+
+    BoundingSphere Transformed(const glm::mat4& transform) const;
+};
+
+// Bounds of a set of points, the sphere is centred on the box
+void CalculateBounds(const glm::vec3* positions, size_t count, size_t stride, BoundingBox& box, BoundingSphere& sphere);
+
+// View frustum as six inward facing planes (xyz normal, w distance)
+class Frustum {
+public:
+    glm::vec4 Planes[6];
+
+    // Pulls the planes out of a projection * view matrix
+    void Extract(const glm::mat4& projView);
+    bool TestSphere(const BoundingSphere& sphere) const;
+    bool TestBox(const BoundingBox& box) const;
+    // Tests count spheres given as separate x/y/z/radius arrays, four at a time with SSE.
+    // Writes 1 (visible) or 0 into visible and returns the number visible.
+    size_t TestSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count, uint8_t* visible) const;
+};
+
+// Per-frame culling stage. Objects add their world space bounding spheres,
+// which are then culled against the view frustum as one batch; meshes of
+// visible objects can be tested individually afterwards. Spheres can also be
+// written from jobs by sizing the batch up front and setting each by index.
+class Culler {
+public:
+    struct Stats {
+        GLuint Tested;
+        GLuint Visible;
+        GLuint Culled;
+        GLuint MeshesTested;
+        GLuint MeshesCulled;
+    };
+    Stats FrameStats = {};
+    Frustum View;
+
+    void Begin(const glm::mat4& projView);
+    // Returns the sphere's index for IsVisible
+    GLuint Add(const BoundingSphere& sphere);
+    // Sizes the batch for count spheres to be filled in with Set, safe to call from several threads for different indices
+    void Resize(size_t count);
+    void Set(GLuint index, const BoundingSphere& sphere);
+    void Run();
+    // Same as Run, with the batch split into chunks across the job system
+    void Run(JobSystem& jobs);
+    bool IsVisible(GLuint index) const { return visible[index] != 0; }
+    // Tests a single world space box, counted as a mesh test
+    bool TestBox(const BoundingBox& box);
+private:
+    vector<float> x, y, z, radius;
+    vector<uint8_t> visible;
+};
\ No newline at end of file
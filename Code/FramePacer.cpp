@@ -0,0 +1,138 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <timeapi.h>
+#endif
+
+const int CALIBRATION_SLEEPS = 20;
+// Added to the measured granularity before trusting a sleep to wake up in time
+const std::chrono::microseconds SLEEP_MARGIN(200);
+
+FramePacer::FramePacer() {
+    frameTimes.reserve(STATS_FRAMES);
+    waitTimes.reserve(STATS_FRAMES);
+}
+
+FramePacer::~FramePacer() {
+#ifdef _WIN32
+    if (initialised)
+        timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::Init() {
+    if (initialised) return;
+#ifdef _WIN32
+    // The default scheduler tick is 15.6ms, far too coarse to sleep through a frame
+    timeBeginPeriod(1);
+#endif
+    calibrate();
+    initialised = true;
+}
+
+void FramePacer::calibrate() {
+    // The worst of a handful of short sleeps, the occasional long one is what misses deadlines
+    Clock::duration worst = Clock::duration::zero();
+    for (int i=0; i<CALIBRATION_SLEEPS; i++) {
+        Clock::time_point before = Clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        worst = std::max(worst, Clock::now() - before);
+    }
+    sleepGranularity = worst;
+}
+
+void FramePacer::SetTargetRate(double framesPerSecond) {
+    targetRate = framesPerSecond > 0 ? framesPerSecond : 0;
+    period = targetRate > 0
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetRate))
+        : Clock::duration::zero();
+    started = false;
+}
+
+void FramePacer::SetVsync(bool enabled) {
+    vsync = enabled;
+    glfwSwapInterval(enabled ? 1 : 0);
+}
+
+double FramePacer::BeginFrame() {
+    Clock::time_point now = Clock::now();
+    double elapsed = 0;
+    if (started) {
+        elapsed = std::chrono::duration<double>(now - frameStart).count();
+        if (frameTimes.size() < STATS_FRAMES) {
+            frameTimes.push_back(elapsed * 1000.0);
+            waitTimes.push_back(lastWait);
+        } else {
+            frameTimes[nextSample] = elapsed * 1000.0;
+            waitTimes[nextSample] = lastWait;
+        }
+        nextSample = (nextSample + 1) % STATS_FRAMES;
+        lastWait = 0;
+    } else {
+        deadline = now;
+        started = true;
+    }
+    frameStart = now;
+    return elapsed;
+}
+
+void FramePacer::Wait() {
+    if (period == Clock::duration::zero()) return;
+
+    Clock::time_point now = Clock::now();
+    deadline += period;
+    // More than a frame behind, a hitch. Start again from now rather than rushing to catch up.
+    if (deadline + period < now)
+        deadline = now;
+
+    sleepUntil(deadline);
+    lastWait = std::chrono::duration<double, std::milli>(Clock::now() - now).count();
+}
+
+void FramePacer::sleepUntil(Clock::time_point until) {
+    // Coarse sleeps while the OS can be trusted to wake up before the deadline
+    Clock::duration safety = sleepGranularity + SLEEP_MARGIN;
+    while (true) {
+        Clock::duration remaining = until - Clock::now();
+        if (remaining <= safety) break;
+        std::this_thread::sleep_for(remaining - safety);
+    }
+    // Then spin the last stretch
+    while (Clock::now() < until) {
+        std::this_thread::yield();
+    }
+}
+
+FramePacer::Stats FramePacer::GetStats() const {
+    Stats stats;
+    stats.SleepGranularityMs = std::chrono::duration<double, std::milli>(sleepGranularity).count();
+    if (frameTimes.empty()) return stats;
+
+    double total = 0, waited = 0;
+    for (size_t i=0; i<frameTimes.size(); i++) {
+        total += frameTimes[i];
+        waited += waitTimes[i];
+    }
+    stats.MeanMs = total / frameTimes.size();
+    stats.WaitMs = waited / frameTimes.size();
+
+    double variance = 0;
+    for (double time : frameTimes) {
+        variance += (time - stats.MeanMs) * (time - stats.MeanMs);
+    }
+    stats.JitterMs = std::sqrt(variance / frameTimes.size());
+
+    std::vector<double> sorted = frameTimes;
+    size_t rank = std::min(sorted.size() - 1, (size_t)std::ceil(sorted.size() * 0.99) - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    stats.P99Ms = sorted[rank];
+    return stats;
+}
\ No newline at end of file
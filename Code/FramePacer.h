@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+// Paces the main loop to a target frame rate without burning a core. Waits
+// sleep in coarse steps until the deadline is within the measured OS sleep
+// granularity, then spin out the rest. Deadlines follow on from each other
+// rather than from whenever the frame finished, so the rate doesn't drift.
+class FramePacer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Over the last STATS_FRAMES frames
+    struct Stats {
+        double MeanMs = 0;
+        double P99Ms = 0;
+        double JitterMs = 0; // Standard deviation of the frame time
+        double WaitMs = 0; // Mean time spent waiting per frame
+        double SleepGranularityMs = 0;
+    };
+    static const size_t STATS_FRAMES = 240;
+
+    FramePacer();
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+    ~FramePacer();
+
+    // Raises the OS timer resolution and measures sleep granularity. Call once
+    // before the first frame; it takes a few dozen milliseconds, so the
+    // constructor leaves it to whoever actually runs a frame loop.
+    void Init();
+
+    // 0 runs uncapped
+    void SetTargetRate(double framesPerSecond);
+    double TargetRate() const { return targetRate; }
+    // Swap interval for the current GLFW context, needs one to be current
+    void SetVsync(bool enabled);
+    bool Vsync() const { return vsync; }
+
+    // Marks the start of a frame, returning the seconds since the last one started
+    double BeginFrame();
+    // Blocks until the next frame is due. Call after swapping buffers.
+    void Wait();
+
+    Stats GetStats() const;
+private:
+    double targetRate = 0;
+    bool vsync = false;
+    Clock::duration period = Clock::duration::zero();
+    Clock::duration sleepGranularity = Clock::duration::zero();
+    Clock::time_point frameStart;
+    Clock::time_point deadline;
+    bool started = false;
+    bool initialised = false;
+
+    // Ring buffers of frame and wait times, in milliseconds
+    std::vector<double> frameTimes;
+    std::vector<double> waitTimes;
+    size_t nextSample = 0;
+    double lastWait = 0;
+
+    // Measures how long a 1ms sleep really takes on this system
+    void calibrate();
+    void sleepUntil(Clock::time_point until);
+};
\ No newline at end of file
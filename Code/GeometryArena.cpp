@@ -0,0 +1,246 @@
+#include "GeometryArena.h"
+
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+
+// Free compacts once the free space is this fragmented and split into at least this many blocks
+const float COMPACT_FRAGMENTATION = 0.5f;
+const size_t COMPACT_MIN_BLOCKS = 8;
+
+GeometryArena::GeometryArena(GLsizei vertexStride, std::vector<VertexAttribute> attributes, GLuint initialVertices, GLuint initialIndices)
+	: stride(vertexStride), attributes(attributes)
+{
+	vertices.ElementSize = vertexStride;
+	vertices.Capacity = initialVertices;
+	// Indices are allocated by the byte so both index types fit in one buffer
+	indices.ElementSize = 1;
+	indices.Capacity = initialIndices * sizeof(GLuint);
+	// Handle 0 means no allocation
+	ranges.push_back(Range{});
+	live.push_back(false);
+}
+
+void GeometryArena::init() {
+	glGenVertexArrays(1, &VAO);
+	for (Pool* pool : { &vertices, &indices }) {
+		glGenBuffers(1, &pool->Buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, pool->Buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, pool->Capacity * pool->ElementSize, nullptr, GL_STATIC_DRAW);
+		pool->FreeBlocks[0] = pool->Capacity;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	bindBuffers();
+}
+
+void GeometryArena::bindBuffers() {
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, vertices.Buffer);
+	for (auto& attribute : attributes) {
+		glEnableVertexAttribArray(attribute.Location);
+		glVertexAttribPointer(attribute.Location, attribute.Size, attribute.Type, attribute.Normalized, stride, (void*)attribute.Offset);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.Buffer);
+	glBindVertexArray(0);
+}
+
+GLuint GeometryArena::Allocate(const void* vertexData, GLuint vertexCount, const void* indexData, GLuint indexCount, GLenum indexType) {
+	if (VAO == 0) init();
+
+	Range range;
+	range.VertexCount = vertexCount;
+	range.IndexCount = indexCount;
+	range.IndexType = indexType;
+	GLuint indexSize = indexBytes(range);
+	GLuint vertexOffset, indexOffset;
+	if (!take(vertices, vertexCount, vertexOffset)) {
+		grow(vertices, vertexCount);
+		take(vertices, vertexCount, vertexOffset);
+	}
+	if (!take(indices, indexSize, indexOffset)) {
+		grow(indices, indexSize);
+		take(indices, indexSize, indexOffset);
+	}
+	range.BaseVertex = (GLint)vertexOffset;
+	range.IndexOffset = indexOffset;
+
+	// The copy targets keep uploads from touching whatever VAO is bound
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertices.Buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * vertices.ElementSize, vertexCount * vertices.ElementSize, vertexData);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indices.Buffer);
+	GLuint indexStride = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, indexCount * indexStride, indexData);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	GLuint handle;
+	if (!freeHandles.empty()) {
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+		ranges[handle] = range;
+		live[handle] = true;
+	} else {
+		handle = (GLuint)ranges.size();
+		ranges.push_back(range);
+		live.push_back(true);
+	}
+	return handle;
+}
+
+void GeometryArena::Free(GLuint handle) {
+	if (handle == 0 || handle >= ranges.size() || !live[handle]) return;
+	const Range& range = ranges[handle];
+	give(vertices, (GLuint)range.BaseVertex, range.VertexCount);
+	give(indices, range.IndexOffset, indexBytes(range));
+	vertices.Used -= range.VertexCount;
+	indices.Used -= indexBytes(range);
+	live[handle] = false;
+	freeHandles.push_back(handle);
+
+	if ((vertices.FreeBlocks.size() >= COMPACT_MIN_BLOCKS && fragmentation(vertices) > COMPACT_FRAGMENTATION) ||
+		(indices.FreeBlocks.size() >= COMPACT_MIN_BLOCKS && fragmentation(indices) > COMPACT_FRAGMENTATION))
+		Compact();
+}
+
+bool GeometryArena::take(Pool& pool, GLuint count, GLuint& offset) {
+	for (auto iter = pool.FreeBlocks.begin(); iter != pool.FreeBlocks.end(); iter++) {
+		if (iter->second < count) continue;
+		offset = iter->first;
+		GLuint remaining = iter->second - count;
+		pool.FreeBlocks.erase(iter);
+		if (remaining > 0)
+			pool.FreeBlocks[offset + count] = remaining;
+		pool.Used += count;
+		return true;
+	}
+	return false;
+}
+
+void GeometryArena::give(Pool& pool, GLuint offset, GLuint count) {
+	if (count == 0) return;
+	auto next = pool.FreeBlocks.lower_bound(offset);
+	// Merge with the block after
+	if (next != pool.FreeBlocks.end() && next->first == offset + count) {
+		count += next->second;
+		next = pool.FreeBlocks.erase(next);
+	}
+	// And the block before
+	if (next != pool.FreeBlocks.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			prev->second += count;
+			return;
+		}
+	}
+	pool.FreeBlocks[offset] = count;
+}
+
+void GeometryArena::grow(Pool& pool, GLuint needed) {
+	GLuint oldCapacity = pool.Capacity;
+	GLuint newCapacity = std::max(oldCapacity * 2, oldCapacity + needed);
+
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * pool.ElementSize, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, pool.Buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity * pool.ElementSize);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &pool.Buffer);
+
+	pool.Buffer = buffer;
+	pool.Capacity = newCapacity;
+	// The new space joins any free block at the old end
+	give(pool, oldCapacity, newCapacity - oldCapacity);
+	bindBuffers();
+}
+
+void GeometryArena::Compact() {
+	if (VAO == 0) return;
+
+	// Live allocations in buffer order, so each only ever moves down
+	std::vector<GLuint> order;
+	for (GLuint handle = 1; handle < ranges.size(); handle++) {
+		if (live[handle]) order.push_back(handle);
+	}
+
+	// Ranges in the same buffer can't overlap in glCopyBufferSubData, so pack into fresh buffers
+	for (Pool* pool : { &vertices, &indices }) {
+		bool vertexPool = pool == &vertices;
+		std::sort(order.begin(), order.end(), [&](GLuint a, GLuint b) {
+			return vertexPool ? ranges[a].BaseVertex < ranges[b].BaseVertex : ranges[a].IndexOffset < ranges[b].IndexOffset;
+		});
+
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, pool->Capacity * pool->ElementSize, nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_READ_BUFFER, pool->Buffer);
+		GLuint offset = 0;
+		for (GLuint handle : order) {
+			Range& range = ranges[handle];
+			GLuint from = vertexPool ? (GLuint)range.BaseVertex : range.IndexOffset;
+			GLuint count = vertexPool ? range.VertexCount : indexBytes(range);
+			if (count > 0)
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from * pool->ElementSize, offset * pool->ElementSize, count * pool->ElementSize);
+			if (vertexPool)
+				range.BaseVertex = (GLint)offset;
+			else
+				range.IndexOffset = offset;
+			offset += count;
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &pool->Buffer);
+
+		pool->Buffer = buffer;
+		pool->FreeBlocks.clear();
+		if (offset < pool->Capacity)
+			pool->FreeBlocks[offset] = pool->Capacity - offset;
+	}
+	bindBuffers();
+	compactions++;
+}
+
+float GeometryArena::fragmentation(const Pool& pool) {
+	GLuint total = 0, largest = 0;
+	for (auto& block : pool.FreeBlocks) {
+		total += block.second;
+		largest = std::max(largest, block.second);
+	}
+	return total == 0 ? 0.0f : 1.0f - (float)largest / total;
+}
+
+GLuint GeometryArena::indexBytes(const Range& range) {
+	GLuint bytes = range.IndexCount * (range.IndexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+	return (bytes + 3) & ~3u;
+}
+
+GeometryArena::Stats GeometryArena::GetStats() const {
+	Stats stats = {};
+	stats.VertexBytesUsed = (size_t)vertices.Used * vertices.ElementSize;
+	stats.VertexBytesCapacity = VAO != 0 ? (size_t)vertices.Capacity * vertices.ElementSize : 0;
+	stats.IndexBytesUsed = (size_t)indices.Used * indices.ElementSize;
+	stats.IndexBytesCapacity = VAO != 0 ? (size_t)indices.Capacity * indices.ElementSize : 0;
+	stats.Allocations = (GLuint)(ranges.size() - 1 - freeHandles.size());
+	stats.FreeBlocks = (GLuint)(vertices.FreeBlocks.size() + indices.FreeBlocks.size());
+	stats.Fragmentation = std::max(fragmentation(vertices), fragmentation(indices));
+	stats.Compactions = compactions;
+	return stats;
+}
+
+void GeometryArena::Clear() {
+	if (VAO == 0) return;
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &vertices.Buffer);
+	glDeleteBuffers(1, &indices.Buffer);
+	VAO = 0;
+	for (Pool* pool : { &vertices, &indices }) {
+		pool->Buffer = 0;
+		pool->Used = 0;
+		pool->FreeBlocks.clear();
+	}
+	ranges.resize(1);
+	live.resize(1);
+	freeHandles.clear();
+}
\ No newline at end of file
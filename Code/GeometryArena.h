@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include <GL/glew.h>
+
+// One attribute of a vertex format, as passed to glVertexAttribPointer
+struct VertexAttribute {
+	GLuint Location;
+	GLint Size;
+	GLenum Type;
+	GLboolean Normalized;
+	size_t Offset;
+};
+
+// Sub-allocates the vertex and index data of every mesh sharing a vertex
+// format out of one large vertex buffer and one large index buffer, drawn
+// through a single VAO with glDrawElementsBaseVertex. Space is handed out
+// first fit from a free list; freed ranges merge with their neighbours and
+// the buffers double when nothing fits. Once the free space is badly split
+// up, Free packs everything back together with Compact.
+class GeometryArena
+{
+public:
+	// Where an allocation currently lives. Compaction moves these, so look them up at draw time.
+	struct Range {
+		GLint BaseVertex;
+		GLuint VertexCount;
+		GLuint IndexOffset; // In bytes, as glDrawElements takes it
+		GLuint IndexCount;
+		GLenum IndexType; // GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+	};
+	struct Stats {
+		size_t VertexBytesUsed, VertexBytesCapacity;
+		size_t IndexBytesUsed, IndexBytesCapacity;
+		GLuint Allocations;
+		GLuint FreeBlocks;
+		// 0 when the free space is one block, towards 1 as it splinters
+		float Fragmentation;
+		GLuint Compactions;
+	};
+
+	// Nothing is created until the first allocation, so arenas can be globals
+	GeometryArena(GLsizei vertexStride, std::vector<VertexAttribute> attributes, GLuint initialVertices = 1 << 18, GLuint initialIndices = 1 << 20);
+
+	// Copies the data in and returns a handle to it, never 0. Meshes with
+	// 16 and 32 bit indices can share an arena.
+	GLuint Allocate(const void* vertices, GLuint vertexCount, const void* indices, GLuint indexCount, GLenum indexType = GL_UNSIGNED_INT);
+	void Free(GLuint handle);
+	const Range& Get(GLuint handle) const { return ranges[handle]; }
+	// Moves every allocation down to the start of its buffer, leaving one free block at the end
+	void Compact();
+
+	GLuint VertexArray() const { return VAO; }
+	Stats GetStats() const;
+	// Deletes the buffers. Needs the GL context.
+	void Clear();
+private:
+	// One buffer, measured in elements (vertices, or bytes for indices)
+	struct Pool {
+		GLuint Buffer = 0;
+		GLsizeiptr ElementSize = 0;
+		GLuint Capacity = 0;
+		GLuint Used = 0;
+		std::map<GLuint, GLuint> FreeBlocks; // Offset -> count
+	};
+
+	GLsizei stride;
+	std::vector<VertexAttribute> attributes;
+	GLuint VAO = 0;
+	Pool vertices;
+	Pool indices;
+	std::vector<Range> ranges; // Indexed by handle, 0 is never handed out
+	std::vector<bool> live;
+	std::vector<GLuint> freeHandles;
+	GLuint compactions = 0;
+
+	void init();
+	// Points the VAO at the current buffers
+	void bindBuffers();
+	// First fit out of the free list, false if no block is big enough
+	static bool take(Pool& pool, GLuint count, GLuint& offset);
+	// Returns a block to the free list. Doesn't touch Used, so growing can add space with it too.
+	static void give(Pool& pool, GLuint offset, GLuint count);
+	// Replaces the pool's buffer with a bigger one holding the same contents
+	void grow(Pool& pool, GLuint needed);
+	static float fragmentation(const Pool& pool);
+	// Bytes of index space a range takes, kept 4 byte aligned
+	static GLuint indexBytes(const Range& range);
+};
\ No newline at end of file
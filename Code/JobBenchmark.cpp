@@ -0,0 +1,107 @@
+#include "JobBenchmark.h"
+#include "JobSystem.h"
+#include "Culling.h"
+#include "TransformSystem.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+const size_t OBJECT_COUNTS[] = { 10000, 50000, 100000 };
+const int WARMUP_FRAMES = 5;
+const int TIMED_FRAMES = 50;
+// Same as the game's grain so the numbers carry over
+const size_t OBJECT_GRAIN = 256;
+const float WORLD_SIZE = 200.0f;
+// One in this many objects moves each frame, the rest stay put like most of a level would
+const size_t MOVING_STRIDE = 4;
+
+// Stand in for a Model: the moving ones drift and spin each update, then every one is bounded and culled
+struct BenchObject {
+    TransformId Transform;
+    glm::vec3 Velocity;
+    glm::vec3 Spin;
+};
+
+static float randomRange(unsigned int& seed, float min, float max) {
+    // LCG so every run, and every thread count, sees the same scene
+    seed = seed * 1664525u + 1013904223u;
+    return min + (max - min) * ((seed >> 8) / float(1 << 24));
+}
+
+static double runFrames(JobSystem& jobs, TransformSystem& transforms, vector<BenchObject>& objects, Culler& culler, size_t& visible) {
+    const float dt = 1.0f / 60.0f;
+    const BoundingSphere localSphere = { glm::vec3(0), 1.0f };
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, WORLD_SIZE);
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 0, WORLD_SIZE * 0.5f), glm::vec3(0), glm::vec3(0, 1, 0));
+
+    auto frame = [&]() {
+        jobs.ParallelFor(objects.size(), OBJECT_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i=begin; i<end; i++) {
+                if (i % MOVING_STRIDE != 0) continue;
+                const BenchObject& object = objects[i];
+                transforms.SetPosition(object.Transform, transforms.GetPosition(object.Transform) + object.Velocity * dt);
+                transforms.SetRotation(object.Transform, transforms.GetRotation(object.Transform) + object.Spin * dt);
+            }
+        });
+        transforms.Update(jobs);
+        culler.Begin(projection * view);
+        culler.Resize(objects.size());
+        jobs.ParallelFor(objects.size(), OBJECT_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i=begin; i<end; i++) {
+                culler.Set((GLuint)i, localSphere.Transformed(transforms.World(objects[i].Transform)));
+            }
+        });
+        culler.Run(jobs);
+    };
+
+    for (int i=0; i<WARMUP_FRAMES; i++) frame();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<TIMED_FRAMES; i++) frame();
+    auto elapsed = std::chrono::high_resolution_clock::now() - start;
+    visible = culler.FrameStats.Visible;
+    return std::chrono::duration<double, std::milli>(elapsed).count() / TIMED_FRAMES;
+}
+
+int JobBenchmark::Run() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    if (cores == 0) cores = 1;
+    vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < cores; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(cores);
+
+    printf("[JOBS] Benchmark - %u cores, %d frames per run\n", cores, TIMED_FRAMES);
+    for (size_t count : OBJECT_COUNTS) {
+        double baseline = 0;
+        for (unsigned int threads : threadCounts) {
+            // Every run starts from the same scene
+            TransformSystem transforms;
+            vector<BenchObject> objects(count);
+            unsigned int seed = 1;
+            for (auto& object : objects) {
+                float half = WORLD_SIZE * 0.5f;
+                glm::vec3 position(randomRange(seed, -half, half), randomRange(seed, -half, half), randomRange(seed, -half, half));
+                object.Transform = transforms.Create(position, glm::vec3(0), glm::vec3(randomRange(seed, 0.5f, 2.0f)));
+                object.Velocity = glm::vec3(randomRange(seed, -1, 1), randomRange(seed, -1, 1), randomRange(seed, -1, 1));
+                object.Spin = glm::vec3(randomRange(seed, -2, 2), randomRange(seed, -2, 2), randomRange(seed, -2, 2));
+            }
+            JobSystem jobs((int)threads - 1);
+            Culler culler;
+            size_t visible = 0;
+            double ms = runFrames(jobs, transforms, objects, culler, visible);
+            if (threads == 1) baseline = ms;
+            auto stats = jobs.GetStats();
+            printf("[JOBS] %6zu objects, %2u threads: %7.3f ms/frame, %5.2fx speedup, %zu visible, %zu jobs (%zu stolen)\n",
+                count, threads, ms, baseline / ms, visible, stats.Executed, stats.Stolen);
+        }
+    }
+    return 0;
+}
\ No newline at end of file
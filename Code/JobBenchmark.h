@@ -0,0 +1,11 @@
+#pragma once
+
+// Measures how the per-frame object work (update, transform, cull) scales
+// across the job system with the number of threads and objects. A quarter
+// of the objects move each frame. Runs without a window or GL context.
+class JobBenchmark
+{
+public:
+    // Prints ms per frame and speedup over one thread for each object count and thread count
+    static int Run();
+};
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <string>
+
+#include "Profiler.h"
+
+// Which system the current thread works for, and its queue in that system
+static thread_local const JobSystem* workerSystem = nullptr;
+static thread_local unsigned int workerQueue = 0;
+
+JobSystem::JobSystem(int workerCount) : queued(0), executed(0), stolen(0) {
+    if (workerCount < 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        workerCount = cores > 1 ? cores - 1 : 0;
+    }
+    for (int i=0; i<=workerCount; i++) {
+        queues.emplace_back(new Queue());
+    }
+    for (int i=1; i<=workerCount; i++) {
+        workers.emplace_back(&JobSystem::workerLoop, this, (unsigned int)i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned int JobSystem::currentQueue() const {
+    return workerSystem == this ? workerQueue : 0;
+}
+
+void JobSystem::Run(Job job, Counter* signal, Counter* after) {
+    if (signal != nullptr) signal->value++;
+    if (after != nullptr) {
+        std::lock_guard<std::mutex> lock(after->mutex);
+        if (after->value.load() > 0) {
+            after->waiting.push_back(Counter::Held{ std::move(job), signal });
+            return;
+        }
+    }
+    push(currentQueue(), Task{ std::move(job), signal });
+}
+
+void JobSystem::push(unsigned int queue, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(queues[queue]->Mutex);
+        queues[queue]->Tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+bool JobSystem::runOne(unsigned int self) {
+    Task task;
+    bool found = false;
+    {
+        // Newest first from our own queue, it is the most likely to still be in cache
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.Mutex);
+        if (!own.Tasks.empty()) {
+            task = std::move(own.Tasks.back());
+            own.Tasks.pop_back();
+            found = true;
+        }
+    }
+    // Oldest first from everyone else's, those tend to be the biggest pieces of work
+    for (size_t i=1; i<queues.size() && !found; i++) {
+        Queue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.Mutex);
+        if (!victim.Tasks.empty()) {
+            task = std::move(victim.Tasks.front());
+            victim.Tasks.pop_front();
+            found = true;
+            stolen++;
+        }
+    }
+    if (!found) return false;
+
+    queued--;
+    {
+        PROFILE_ZONE("Job");
+        task.Function();
+    }
+    executed++;
+    finish(task.Signal);
+    return true;
+}
+
+void JobSystem::finish(Counter* counter) {
+    if (counter == nullptr) return;
+    // Decrementing under the lock keeps waiters from seeing zero, and freeing
+    // the counter, before we are done with it
+    std::vector<Counter::Held> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (--counter->value > 0) return;
+        ready.swap(counter->waiting);
+    }
+    unsigned int queue = currentQueue();
+    for (auto& held : ready) {
+        push(queue, Task{ std::move(held.Function), held.Signal });
+    }
+}
+
+void JobSystem::Wait(Counter& counter) {
+    unsigned int self = currentQueue();
+    while (!counter.Done()) {
+        if (!runOne(self))
+            std::this_thread::yield();
+    }
+    // Let the job that finished it let go of the counter
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+    // Not worth the queueing when there is only one chunk or no one to share it with
+    if (count <= grain || workers.empty()) {
+        body(0, count);
+        return;
+    }
+    Counter done;
+    for (size_t begin = 0; begin < count; begin += grain) {
+        size_t end = std::min(begin + grain, count);
+        Run([&body, begin, end] { body(begin, end); }, &done);
+    }
+    Wait(done);
+}
+
+JobSystem::Stats JobSystem::GetStats() const {
+    Stats stats;
+    stats.Executed = executed.load();
+    stats.Stolen = stolen.load();
+    return stats;
+}
+
+void JobSystem::workerLoop(unsigned int index) {
+    workerSystem = this;
+    workerQueue = index;
+    Profiler::SetThreadName("Job worker " + std::to_string(index));
+    while (true) {
+        if (runOne(index)) continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+        // Finish whatever is queued before shutting down
+        if (stopping && queued.load() == 0) return;
+    }
+}
\ No newline at end of file
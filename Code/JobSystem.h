@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing job system for short, CPU bound jobs on the frame's critical
+// path. Every thread has its own deque: it pushes and pops its own jobs at
+// the back, and idle threads steal from the front of the others. Threads
+// waiting on jobs run queued ones instead of blocking, so the thread calling
+// in is one more worker. Nothing here touches the GL, keep GL calls on the
+// main thread. For long, blocking work like file loads use ThreadPool.
+class JobSystem
+{
+public:
+    typedef std::function<void()> Job;
+
+    // Counts jobs still to finish. Waiting on a counter waits for every job
+    // that signals it, and jobs can be held back until one reaches zero.
+    class Counter {
+    public:
+        Counter() : value(0) {}
+        Counter(const Counter&) = delete;
+        Counter& operator=(const Counter&) = delete;
+        bool Done() const { return value.load() == 0; }
+    private:
+        friend class JobSystem;
+        struct Held {
+            Job Function;
+            Counter* Signal;
+        };
+        std::atomic<int> value;
+        std::mutex mutex;
+        std::vector<Held> waiting; // Queued once value reaches zero
+    };
+
+    struct Stats {
+        size_t Executed;
+        size_t Stolen;
+    };
+
+    // Negative means one worker per core, leaving one for the calling thread.
+    // 0 workers runs every job on the threads that wait on them.
+    JobSystem(int workerCount = -1);
+    ~JobSystem();
+
+    // Queues a job. signal, if given, counts up now and back down once the job
+    // has run. The job is held until after reaches zero, if given.
+    void Run(Job job, Counter* signal = nullptr, Counter* after = nullptr);
+    // Runs queued jobs until the counter reaches zero
+    void Wait(Counter& counter);
+    // Calls body(begin, end) over [0, count) in chunks of at most grain, returning once they are all done
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+    // Workers plus the calling thread
+    unsigned int Threads() const { return (unsigned int)workers.size() + 1; }
+    Stats GetStats() const;
+private:
+    struct Task {
+        Job Function;
+        Counter* Signal;
+    };
+    struct Queue {
+        std::mutex Mutex;
+        std::deque<Task> Tasks;
+    };
+
+    // Queue 0 is shared by every thread outside the system, workers have one each after it
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued;
+    std::atomic<size_t> executed;
+    std::atomic<size_t> stolen;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    unsigned int currentQueue() const;
+    void push(unsigned int queue, Task task);
+    // Runs one job from this thread's queue, or stolen from another. False if there was none.
+    bool runOne(unsigned int self);
+    void finish(Counter* counter);
+    void workerLoop(unsigned int index);
+};
\ No newline at end of file
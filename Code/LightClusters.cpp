@@ -0,0 +1,244 @@
+#include "LightClusters.h"
+#include "JobSystem.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define LIGHTS_SSE
+#include <xmmintrin.h>
+#endif
+
+// Centre of the spheres padding a batch out to four, far enough away to never touch a cluster
+const float PADDING_DISTANCE = 1e18f;
+
+// Bit i set if sphere i of the four touches the box
+static int testSpheres(const glm::vec3& boxMin, const glm::vec3& boxMax, const float* x, const float* y, const float* z, const float* radius) {
+#ifdef LIGHTS_SSE
+    const __m128 zero = _mm_setzero_ps();
+    __m128 cx = _mm_loadu_ps(x), cy = _mm_loadu_ps(y), cz = _mm_loadu_ps(z), r = _mm_loadu_ps(radius);
+    // Distance from each centre to the box along each axis, zero when inside its span
+    __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(boxMin.x), cx), zero), _mm_max_ps(_mm_sub_ps(cx, _mm_set1_ps(boxMax.x)), zero));
+    __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(boxMin.y), cy), zero), _mm_max_ps(_mm_sub_ps(cy, _mm_set1_ps(boxMax.y)), zero));
+    __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(boxMin.z), cz), zero), _mm_max_ps(_mm_sub_ps(cz, _mm_set1_ps(boxMax.z)), zero));
+    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    return _mm_movemask_ps(_mm_cmple_ps(distance, _mm_mul_ps(r, r)));
+#else
+    int mask = 0;
+    for (int i = 0; i < 4; i++) {
+        glm::vec3 center(x[i], y[i], z[i]);
+        glm::vec3 offset = glm::max(boxMin - center, glm::vec3(0)) + glm::max(center - boxMax, glm::vec3(0));
+        if (glm::dot(offset, offset) <= radius[i] * radius[i])
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+void LightClusters::Init() {
+    glGenBuffers(1, &lightBuffer);
+    glGenBuffers(1, &itemBuffer);
+    glGenTextures(1, &lightTexture);
+    glGenTextures(1, &itemTexture);
+
+    // Buffer textures need storage behind them before the first upload
+    glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * 2, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, itemBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(GLuint) * CLUSTER_COUNT, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, itemTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, itemBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    slices.resize(CLUSTER_Z);
+    clusterMin.resize(CLUSTER_COUNT);
+    clusterMax.resize(CLUSTER_COUNT);
+
+    Shader::RegisterSampler("lightData", LIGHT_DATA_UNIT);
+    Shader::RegisterSampler("clusterItems", CLUSTER_ITEMS_UNIT);
+}
+
+float LightClusters::sliceDepth(int z) const {
+    return nearPlane * powf(farPlane / nearPlane, (float)z / CLUSTER_Z);
+}
+
+int LightClusters::depthSlice(float depth) const {
+    if (depth <= nearPlane) return 0;
+    int z = (int)floorf(logf(depth / nearPlane) / logf(farPlane / nearPlane) * CLUSTER_Z);
+    return std::min(z, CLUSTER_Z - 1);
+}
+
+void LightClusters::Begin(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane) {
+    this->view = view;
+    GLint rect[4];
+    glGetIntegerv(GL_VIEWPORT, rect);
+    viewport = glm::vec4(rect[0], rect[1], rect[2], rect[3]);
+    if (projection != gridProjection || nearPlane != this->nearPlane || farPlane != this->farPlane) {
+        gridProjection = projection;
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+        buildGrid();
+    }
+    lights.clear();
+    FrameStats = Stats{};
+}
+
+void LightClusters::buildGrid() {
+    // A view space point at depth d lands on ndc (x * P00 - P20 * d) / d, run that backwards for each corner
+    const glm::mat4& p = gridProjection;
+    for (int z = 0; z < CLUSTER_Z; z++) {
+        float depths[2] = { sliceDepth(z), sliceDepth(z + 1) };
+        for (int y = 0; y < CLUSTER_Y; y++) {
+            for (int x = 0; x < CLUSTER_X; x++) {
+                glm::vec3 low(INFINITY), high(-INFINITY);
+                for (float depth : depths) {
+                    for (int corner = 0; corner < 4; corner++) {
+                        float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / CLUSTER_X;
+                        float ndcY = -1.0f + 2.0f * (y + (corner >> 1)) / CLUSTER_Y;
+                        glm::vec3 point((ndcX + p[2][0]) * depth / p[0][0], (ndcY + p[2][1]) * depth / p[1][1], -depth);
+                        low = glm::min(low, point);
+                        high = glm::max(high, point);
+                    }
+                }
+                GLuint index = x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y;
+                clusterMin[index] = low;
+                clusterMax[index] = high;
+            }
+        }
+    }
+}
+
+void LightClusters::Add(const PointLight& light) {
+    lights.push_back(light);
+}
+
+void LightClusters::Build(JobSystem& jobs) {
+    size_t count = lights.size();
+    viewX.resize(count);
+    viewY.resize(count);
+    viewZ.resize(count);
+    radius.resize(count);
+    firstSlice.resize(count);
+    lastSlice.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].Position, 1));
+        viewX[i] = center.x;
+        viewY[i] = center.y;
+        viewZ[i] = center.z;
+        radius[i] = lights[i].Range;
+        // Lights wholly behind the camera or past the far plane touch no slice
+        float depth = -center.z;
+        if (depth + lights[i].Range < nearPlane || depth - lights[i].Range > farPlane) {
+            firstSlice[i] = 1;
+            lastSlice[i] = 0;
+        } else {
+            firstSlice[i] = depthSlice(depth - lights[i].Range);
+            lastSlice[i] = depthSlice(depth + lights[i].Range);
+        }
+    }
+
+    jobs.ParallelFor(CLUSTER_Z, 1, [this](size_t begin, size_t end) {
+        for (size_t z = begin; z < end; z++) {
+            assignSlice((int)z);
+        }
+    });
+
+    // Stitch the slices together, the grid first and each cluster's indices after it
+    const GLuint perSlice = CLUSTER_X * CLUSTER_Y;
+    items.resize(CLUSTER_COUNT);
+    GLuint offset = CLUSTER_COUNT;
+    for (int z = 0; z < CLUSTER_Z; z++) {
+        const Slice& slice = slices[z];
+        for (GLuint cluster = 0; cluster < perSlice; cluster++) {
+            items[z * perSlice + cluster] = offset | (slice.Counts[cluster] << 24);
+            offset += slice.Counts[cluster];
+            FrameStats.MaxPerCluster = std::max(FrameStats.MaxPerCluster, slice.Counts[cluster]);
+        }
+        items.insert(items.end(), slice.Lights.begin(), slice.Lights.end());
+        FrameStats.Dropped += slice.Dropped;
+    }
+    FrameStats.Lights = (GLuint)count;
+    FrameStats.Assignments = offset - CLUSTER_COUNT;
+}
+
+void LightClusters::assignSlice(int z) {
+    Slice& slice = slices[z];
+    slice.Lights.clear();
+    slice.Dropped = 0;
+
+    // Gather the lights reaching this slice, padded out to whole batches of four
+    vector<GLuint> candidates;
+    vector<float> x, y, zs, r;
+    for (GLuint i = 0; i < (GLuint)lights.size(); i++) {
+        if (firstSlice[i] > z || lastSlice[i] < z) continue;
+        candidates.push_back(i);
+        x.push_back(viewX[i]);
+        y.push_back(viewY[i]);
+        zs.push_back(viewZ[i]);
+        r.push_back(radius[i]);
+    }
+    while (x.size() % 4 != 0) {
+        x.push_back(PADDING_DISTANCE);
+        y.push_back(PADDING_DISTANCE);
+        zs.push_back(PADDING_DISTANCE);
+        r.push_back(0);
+    }
+
+    const GLuint perSlice = CLUSTER_X * CLUSTER_Y;
+    for (GLuint cluster = 0; cluster < perSlice; cluster++) {
+        GLuint index = z * perSlice + cluster;
+        GLuint found = 0;
+        for (size_t i = 0; i < x.size(); i += 4) {
+            int mask = testSpheres(clusterMin[index], clusterMax[index], &x[i], &y[i], &zs[i], &r[i]);
+            for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+                if (!(mask & 1)) continue;
+                if (found == MAX_CLUSTER_LIGHTS) {
+                    slice.Dropped++;
+                    continue;
+                }
+                slice.Lights.push_back(candidates[i + lane]);
+                found++;
+            }
+        }
+        slice.Counts[cluster] = found;
+    }
+}
+
+void LightClusters::Upload() {
+    // Keep at least one light's worth so the buffer is never empty
+    lightData.resize(std::max<size_t>(lights.size(), 1) * 2);
+    for (size_t i = 0; i < lights.size(); i++) {
+        lightData[i * 2] = glm::vec4(lights[i].Position, lights[i].Range);
+        lightData[i * 2 + 1] = glm::vec4(lights[i].Color, lights[i].Specular);
+    }
+
+    // Respecified every frame so the driver can hand us fresh storage while last frame's draws still read the old
+    GLsizeiptr lightBytes = (GLsizeiptr)(lightData.size() * sizeof(glm::vec4));
+    GLsizeiptr itemBytes = (GLsizeiptr)(items.size() * sizeof(GLuint));
+    glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, lightBytes, &lightData[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, itemBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, itemBytes, &items[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    FrameStats.BytesUploaded = (GLuint)(lightBytes + itemBytes);
+}
+
+void LightClusters::Bind() {
+    glActiveTexture(GL_TEXTURE0 + LIGHT_DATA_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+    glActiveTexture(GL_TEXTURE0 + CLUSTER_ITEMS_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, itemTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void LightClusters::Fill(LightingInfo& info) const {
+    info.Viewport = viewport;
+    // slice = log(depth) * scale + bias, matching depthSlice
+    float scale = CLUSTER_Z / logf(farPlane / nearPlane);
+    info.ClusterDepth = glm::vec4(nearPlane, farPlane, scale, -logf(nearPlane) * scale);
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "LightingInfo.h"
+#include "Material.h"
+
+using std::vector;
+
+class JobSystem;
+
+// Cluster grid, screen tiles across and down by exponential depth slices
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+// Lights past this in one cluster are dropped, the count has 8 bits in the grid
+#define MAX_CLUSTER_LIGHTS 255
+
+// Texture units of the cluster buffers, after the material's
+#define LIGHT_DATA_UNIT MATERIAL_UNITS
+#define CLUSTER_ITEMS_UNIT (MATERIAL_UNITS + 1)
+
+// A point light, fading out to nothing at Range
+struct PointLight {
+    glm::vec3 Position; // World space
+    float Range;
+    glm::vec3 Color;
+    float Specular;
+};
+
+// Scene wide light list, sorted into a view space cluster grid each frame
+// so each fragment only walks the lights that can reach it. Lights are
+// assigned on the CPU, a depth slice per job, testing four lights against
+// a cluster at a time with SSE. Two buffer textures go to the GPU:
+//  lightData    - RGBA32F, two texels per light: position and range, colour and specular
+//  clusterItems - R32UI, one entry per cluster (offset in the low 24 bits, count in the
+//                 high 8) followed by the light indices those entries point at
+class LightClusters
+{
+public:
+    struct Stats {
+        GLuint Lights;
+        GLuint Assignments;   // Light indices written across every cluster
+        GLuint MaxPerCluster;
+        GLuint Dropped;       // Assignments lost to MAX_CLUSTER_LIGHTS
+        GLuint BytesUploaded;
+    };
+    Stats FrameStats = {};
+
+    // Creates the buffers, must come before any shader is loaded
+    void Init();
+    // Starts a new frame's light list, the cluster bounds are rebuilt only when the projection changes
+    void Begin(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+    void Add(const PointLight& light);
+    // Assigns every light added since Begin to the clusters it touches
+    void Build(JobSystem& jobs);
+    void Upload();
+    // Binds the buffer textures to their units
+    void Bind();
+    // Writes the viewport and depth slicing the shader needs to find a fragment's cluster
+    void Fill(LightingInfo& info) const;
+private:
+    // Per slice results, merged into items once every slice is done
+    struct Slice {
+        GLuint Counts[CLUSTER_X * CLUSTER_Y];
+        vector<GLuint> Lights;
+        GLuint Dropped;
+    };
+
+    GLuint lightBuffer = 0, lightTexture = 0;
+    GLuint itemBuffer = 0, itemTexture = 0;
+
+    vector<PointLight> lights;
+    // View space spheres, padded to a multiple of four
+    vector<float> viewX, viewY, viewZ, radius;
+    // First and last depth slice each light touches
+    vector<int> firstSlice, lastSlice;
+    vector<Slice> slices;
+    vector<GLuint> items;
+    vector<glm::vec4> lightData;
+
+    // View space cluster bounds, x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y
+    vector<glm::vec3> clusterMin, clusterMax;
+    glm::mat4 view;
+    glm::mat4 gridProjection;
+    glm::vec4 viewport;
+    float nearPlane = 0, farPlane = 0;
+
+    void buildGrid();
+    void assignSlice(int z);
+    // View depth at the near side of slice z, and the slice a view depth falls in
+    float sliceDepth(int z) const;
+    int depthSlice(float depth) const;
+};
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "LightingBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "Shader.h"
+#include "Util.h"
+
+void LightingBuffer::Init(GLuint initialSets, GLuint framesInFlight)
+{
+	GLint alignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	stride = (GLuint)((sizeof(LightingInfo) + alignment - 1) / alignment * alignment);
+	frames = framesInFlight;
+
+	glGenBuffers(1, &UBO);
+	allocate(initialSets);
+
+	// Any shader compiled from now on gets its "Lighting" block pointed at our binding
+	Shader::RegisterUniformBlock("Lighting", LIGHTING_BINDING);
+}
+
+void LightingBuffer::allocate(GLuint slots)
+{
+	capacity = slots;
+	staging.resize((size_t)capacity * stride);
+	glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+	glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)capacity * stride * frames, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void LightingBuffer::BeginFrame()
+{
+	frameIndex = (frameIndex + 1) % frames;
+	count = 0;
+	boundOffset = -1;
+	slotsByHash.clear();
+	FrameStats = Stats{};
+}
+
+GLuint LightingBuffer::Submit(const LightingInfo& lighting)
+{
+	FrameStats.Submitted++;
+	size_t hash = (size_t)Util::hash_bytes(&lighting, sizeof(LightingInfo));
+	auto range = slotsByHash.equal_range(hash);
+	for (auto iter = range.first; iter != range.second; iter++) {
+		if (memcmp(&staging[(size_t)iter->second * stride], &lighting, sizeof(LightingInfo)) == 0)
+			return iter->second;
+	}
+
+	// Grow the staging area now, the GL buffer catches up in Upload. capacity only
+	// changes there, so size against what is staged this frame, not against it.
+	size_t needed = (size_t)(count + 1) * stride;
+	if (needed > staging.size())
+		staging.resize(std::max(staging.size() * 2, needed));
+	GLuint slot = count++;
+	assert((size_t)(slot + 1) * stride <= staging.size());
+	memcpy(&staging[(size_t)slot * stride], &lighting, sizeof(LightingInfo));
+	slotsByHash.emplace(hash, slot);
+	FrameStats.Distinct++;
+	return slot;
+}
+
+void LightingBuffer::Upload()
+{
+	if (count == 0)
+		return;
+	if ((size_t)capacity * stride < staging.size())
+		allocate((GLuint)(staging.size() / stride));
+
+	glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)frameIndex * capacity * stride, (GLsizeiptr)count * stride, &staging[0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	FrameStats.BytesUploaded += count * stride;
+}
+
+void LightingBuffer::Bind(GLuint slot)
+{
+	GLintptr offset = (GLintptr)(frameIndex * capacity + slot) * stride;
+	if (offset == boundOffset)
+		return;
+	glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTING_BINDING, UBO, offset, sizeof(LightingInfo));
+	boundOffset = offset;
+	FrameStats.RangeBinds++;
+}
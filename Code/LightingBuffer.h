@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include <GL/glew.h>
+
+#include "LightingInfo.h"
+
+// Per-frame ring of lighting blocks held in a single uniform buffer.
+// Light sets are collected while preparing the frame, identical sets are
+// merged, and the whole frame is uploaded with one glBufferSubData call.
+class LightingBuffer
+{
+public:
+	struct Stats {
+		GLuint Submitted; // Light sets handed to Submit
+		GLuint Distinct; // Sets that actually took a slot
+		GLuint BytesUploaded;
+		GLuint RangeBinds;
+	};
+	Stats FrameStats = {};
+
+	// Creates the buffer, sized for initialSets per frame (it grows if needed)
+	void Init(GLuint initialSets = 64, GLuint framesInFlight = 3);
+	// Moves to the next ring segment and forgets last frame's sets
+	void BeginFrame();
+	// Adds a light set to this frame and returns its slot
+	GLuint Submit(const LightingInfo& lighting);
+	// Uploads every set submitted this frame
+	void Upload();
+	// Points LIGHTING_BINDING at the given slot
+	void Bind(GLuint slot);
+private:
+	GLuint UBO = 0;
+	GLuint stride = 0; // sizeof(LightingInfo) rounded up to the offset alignment
+	GLuint capacity = 0; // Slots per frame
+	GLuint frames = 0;
+	GLuint frameIndex = 0;
+	GLuint count = 0;
+	GLintptr boundOffset = -1;
+
+	std::vector<unsigned char> staging;
+	std::unordered_multimap<size_t, GLuint> slotsByHash;
+
+	void allocate(GLuint slots);
+};
\ No newline at end of file
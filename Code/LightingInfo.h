@@ -1,15 +1,15 @@
-#pragma once
-#include <glm/glm.hpp>
-
-#define MAX_LIGHTS 8
-
-struct LightingInfo {
-	glm::vec3 LightPos[MAX_LIGHTS];
-	glm::vec4 LightColor[MAX_LIGHTS];
-	float SpecularStrength[MAX_LIGHTS];
-	bool LightActive[MAX_LIGHTS];
-
-	glm::vec4 AmbientColor;
-	float AmbientStrength;
-	glm::vec3 ViewPos;
+#pragma once
+#include <glm/glm.hpp>
+
+// Uniform buffer binding point of the "Lighting" block
+#define LIGHTING_BINDING 0
+
+// CPU side mirror of the std140 "Lighting" uniform block in material.frag.
+// Everything is a vec4 so the C++ and std140 layouts match. The lights
+// themselves live in the cluster buffers, see LightClusters.h.
+struct LightingInfo {
+	glm::vec4 AmbientColor; // rgb colour, a strength
+	glm::vec4 ViewPos;
+	glm::vec4 Viewport; // xy origin, zw size in pixels
+	glm::vec4 ClusterDepth; // near plane, far plane, then depth slice scale and bias
 };
\ No newline at end of file
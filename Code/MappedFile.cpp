@@ -0,0 +1,81 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    file = handle;
+
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(handle, &length) || length.QuadPart == 0) {
+        Close();
+        return false;
+    }
+    mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        Close();
+        return false;
+    }
+    data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        Close();
+        return false;
+    }
+    size = (size_t)length.QuadPart;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data != nullptr) UnmapViewOfFile(data);
+    if (mapping != nullptr) CloseHandle(mapping);
+    if (file != nullptr) CloseHandle(file);
+    data = nullptr;
+    mapping = nullptr;
+    file = nullptr;
+    size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    // The mapping stays valid after the descriptor is closed
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) return false;
+    data = (const unsigned char*)view;
+    size = (size_t)info.st_size;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data != nullptr) munmap((void*)data, size);
+    data = nullptr;
+    size = 0;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. Closed when the object is destroyed.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    // False if the file is missing, empty or can't be mapped
+    bool Open(const std::string& path);
+    void Close();
+
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+    bool IsOpen() const { return data != nullptr; }
+private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "Material.h"
+
+#include <string>
+#include <stdexcept>
+
+using std::string;
+
+void MaterialUniforms::Resolve(const Shader& shader) {
+    Color = shader.GetUniform("color");
+}
+
+Material::Material()
+    : DiffuseColor(1), Features(0), BindingCount(0)
+{
+}
+
+void Material::Build(const vector<Texture2D>& textures, glm::vec4 diffuseColor) {
+    DiffuseColor = diffuseColor;
+    for (auto& tex : textures) {
+        GLuint unit;
+        switch (tex.Type) {
+            case Texture2D::TextureType::DIFFUSE:
+                if (Features & SHADER_DIFFUSE_MAP) continue;
+                Features |= SHADER_DIFFUSE_MAP;
+                unit = DIFFUSE_UNIT;
+                break;
+            case Texture2D::TextureType::SPECULAR:
+                if (Features & SHADER_SPECULAR_MAP) continue;
+                Features |= SHADER_SPECULAR_MAP;
+                unit = SPECULAR_UNIT;
+                break;
+            default:
+                throw std::runtime_error("Material::Build - Unknown texture type.");
+        }
+        Bindings[BindingCount++] = Binding { GL_TEXTURE0 + unit, tex.ID };
+    }
+}
+
+GLuint Material::Apply(Shader& shader, const MaterialUniforms& uniforms, GLuint* boundTextures) const {
+    shader.SetVector4f(uniforms.Color, &DiffuseColor);
+    GLuint binds = 0;
+    for (GLuint i=0; i<BindingCount; i++) {
+        const Binding& binding = Bindings[i];
+        if (boundTextures != nullptr) {
+            GLuint& bound = boundTextures[binding.Unit - GL_TEXTURE0];
+            if (bound == binding.Texture) continue;
+            bound = binding.Texture;
+        }
+        glActiveTexture(binding.Unit);
+        glBindTexture(GL_TEXTURE_2D, binding.Texture);
+        binds++;
+    }
+    return binds;
+}
+
+uint64_t Material::TextureSet() const {
+    static_assert(MATERIAL_UNITS <= 2, "Material::TextureSet packs one 32 bit texture name per unit");
+    uint64_t set = 0;
+    for (GLuint i=0; i<BindingCount; i++) {
+        GLuint unit = Bindings[i].Unit - GL_TEXTURE0;
+        set |= (uint64_t)Bindings[i].Texture << (32 * unit);
+    }
+    return set;
+}
+
+void Material::RegisterSamplerUnits() {
+    Shader::RegisterSampler("diffuseMap", DIFFUSE_UNIT);
+    Shader::RegisterSampler("specularMap", SPECULAR_UNIT);
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "Texture.h"
+
+using std::vector;
+
+// Fixed texture unit layout used by every material. Shaders sample a mesh's
+// first diffuse and first specular map, any others are left unbound.
+#define DIFFUSE_UNIT 0
+#define SPECULAR_UNIT 1
+#define MATERIAL_UNITS 2
+
+// Uniform handles needed to apply a material, resolved once per shader
+struct MaterialUniforms {
+    UniformId Color;
+
+    void Resolve(const Shader& shader);
+};
+
+// Draw-ready surface description of a mesh, built once at import time.
+// Texture units and shader features are worked out up front, so applying a
+// material is at most two texture binds and a colour upload.
+class Material {
+public:
+    struct Binding {
+        GLenum Unit;
+        GLuint Texture;
+    };
+
+    glm::vec4 DiffuseColor;
+    // SHADER_* features for the maps present, meshes are drawn with the variant built for them
+    GLuint Features;
+    Binding Bindings[MATERIAL_UNITS];
+    GLuint BindingCount;
+
+    Material();
+    void Build(const vector<Texture2D>& textures, glm::vec4 diffuseColor);
+    // Sets the material uniforms and binds its textures. If boundTextures (one entry
+    // per unit) is given, units already holding the right texture are skipped.
+    // Returns the number of textures bound.
+    GLuint Apply(Shader& shader, const MaterialUniforms& uniforms, GLuint* boundTextures = nullptr) const;
+
+    // Texture bound to each unit packed into one value, 0 where a unit is unused.
+    // Materials with equal texture sets need no binds to switch between.
+    uint64_t TextureSet() const;
+
+    // Registers the sampler -> unit layout with Shader. Call before loading shaders.
+    static void RegisterSamplerUnits();
+};
\ No newline at end of file
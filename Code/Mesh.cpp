@@ -1,98 +1,98 @@
-#include "Mesh.h"
-
-#include <string>
-#include <map>
-#include <stdexcept>
-
-using std::string;
-using std::map;
-
-Mesh::Mesh() {
-
-}
-
-void Mesh::Import(vector<MeshVertex> vertices, vector<GLuint> indices, vector<Texture2D> textures) {
-	Vertices = vertices;
-	Indices = indices;
-	Textures = textures;
-
-    glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-
-	glBindVertexArray(VAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(MeshVertex) * Vertices.size(), &Vertices[0], GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * Indices.size(), &Indices[0], GL_STATIC_DRAW);
-
-	// positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)0);
-
-	// normals
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, Normal));
-
-	// texture coordinates
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, TexCoords));
-
-	glBindVertexArray(0);
-}
-
-void Mesh::Draw(Shader& shader, LightingInfo& lighting) {
-
-	shader.SetVector4f("color", &DiffuseColor);
-
-	shader.SetBool("lightActive", (GLboolean *)&lighting.LightActive[0], MAX_LIGHTS);
-	shader.SetVector4f("lightColor", &lighting.LightColor[0], MAX_LIGHTS);
-	shader.SetVector3f("lightPos", &lighting.LightPos[0], MAX_LIGHTS);
-	shader.SetFloat("specularStrength", &lighting.SpecularStrength[0], MAX_LIGHTS);
-
-	shader.SetVector4f("ambientColor", &lighting.AmbientColor);
-	shader.SetFloat("ambientStrength", &lighting.AmbientStrength);
-	shader.SetVector3f("viewPos", &lighting.ViewPos);
-
-	map<Texture2D::TextureType, int> texCounts;
-	
-	GLboolean diffuseActive[MAX_TEXTURES] = {GL_FALSE};
-	GLboolean specularActive[MAX_TEXTURES] = {GL_FALSE};
-	for (GLint i=0; i<Textures.size(); i++) {
-		Texture2D* tex = &Textures[i];
-		glActiveTexture(GL_TEXTURE0 + i);
-		// Maps auto initialise variables
-		//if (texCounts.count(tex->Type) == 0) texCounts[tex->Type] = 0;
-		int number = texCounts[tex->Type]++;
-		string numberStr = std::to_string(number);
-		string name = tex->GetTypeStr();
-		string fullname;
-		switch (tex->Type) {
-			case Texture2D::TextureType::DIFFUSE:
-				fullname = "texture_diffuse[" + numberStr + "]";
-				diffuseActive[number] = GL_TRUE;
-				break;
-			case Texture2D::TextureType::SPECULAR:
-				fullname = "texture_specular[" + numberStr + "]";
-				specularActive[number] = GL_TRUE;
-				break;
-			default:
-				throw new std::runtime_error("Unknown texture type.");
-		}
-		//printf("%s\n", fullname.c_str());
-		// tell shader to use GL_TEXTURE0+i for this texture
-		shader.SetInteger(fullname.c_str(), &i);
-		// bind texture to GL_TEXTURE0+i
-		tex->Bind();
-	}
-	shader.SetBool("diffuseActive", &diffuseActive[0], MAX_TEXTURES);
-	shader.SetBool("specularActive", &specularActive[0], MAX_TEXTURES);
-
-    glBindVertexArray(VAO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glDrawElements(GL_TRIANGLES, Indices.size(), GL_UNSIGNED_INT, 0);
-
-	//glActiveTexture(GL_TEXTURE0);
+#include "Mesh.h"
+
+#include <cstddef>
+
+#include <glm/gtc/packing.hpp>
+
+GeometryArena Mesh::Arena(sizeof(MeshVertex), {
+	{ 0, 3, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, Position) },
+	{ 1, 3, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, Normal) },
+	{ 2, 2, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, TexCoords) },
+});
+
+GeometryArena Mesh::PackedArena(sizeof(PackedVertex), {
+	{ 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, Position) },
+	{ 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, Normal) },
+	{ 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, TexCoords) },
+});
+
+Mesh::Mesh() {
+
+}
+
+void Mesh::Import(vector<MeshVertex> vertices, vector<GLuint> indices, vector<Texture2D> textures, glm::vec4 diffuseColor) {
+	Vertices = std::move(vertices);
+	Indices = std::move(indices);
+	MeshStreams streams;
+	streams.Vertices = Vertices.data();
+	streams.VertexCount = (GLuint)Vertices.size();
+	streams.Indices = Indices.data();
+	streams.IndexCount = (GLuint)Indices.size();
+	Import(streams, std::move(textures), diffuseColor);
+}
+
+void Mesh::Import(const MeshStreams& streams, vector<Texture2D> textures, glm::vec4 diffuseColor) {
+	Textures = std::move(textures);
+	MeshMaterial.Build(Textures, diffuseColor);
+	Format = streams.Format;
+	PositionScale = streams.PositionScale;
+	PositionOffset = streams.PositionOffset;
+	if (streams.LodCount > 0)
+		Lods.assign(streams.Lods, streams.Lods + streams.LodCount);
+	else
+		Lods.assign(1, MeshLod{ 0, streams.IndexCount, 0.0f });
+	geometry = arena().Allocate(streams.Vertices, streams.VertexCount, streams.Indices, streams.IndexCount, streams.IndexType);
+}
+
+void Mesh::Release() {
+	arena().Free(geometry);
+	geometry = 0;
+}
+
+void Mesh::DrawElements(GLsizei instances, GLuint lod) const {
+	const GeometryArena::Range& range = arena().Get(geometry);
+	const MeshLod& level = Lods[lod];
+	GLuint indexSize = range.IndexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	void* firstIndex = (void*)(range.IndexOffset + (size_t)level.FirstIndex * indexSize);
+	if (instances == 1)
+		glDrawElementsBaseVertex(GL_TRIANGLES, level.IndexCount, range.IndexType, firstIndex, range.BaseVertex);
+	else
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.IndexCount, range.IndexType, firstIndex, instances, range.BaseVertex);
+}
+
+void Mesh::PackVertices(const MeshVertex* vertices, GLuint count, const BoundingBox& box, vector<PackedVertex>& packed, MeshStreams& streams) {
+	glm::vec3 size = box.Max - box.Min;
+	// Flat axes keep a scale of 0 and every position lands on the offset
+	glm::vec3 toUnit = glm::vec3(
+		size.x > 0 ? 1 / size.x : 0,
+		size.y > 0 ? 1 / size.y : 0,
+		size.z > 0 ? 1 / size.z : 0
+	);
+	packed.resize(count);
+	for (GLuint i = 0; i < count; i++) {
+		const MeshVertex& in = vertices[i];
+		PackedVertex& out = packed[i];
+		glm::vec3 unit = glm::clamp((in.Position - box.Min) * toUnit, 0.0f, 1.0f);
+		out.Position[0] = (uint16_t)(unit.x * 65535 + 0.5f);
+		out.Position[1] = (uint16_t)(unit.y * 65535 + 0.5f);
+		out.Position[2] = (uint16_t)(unit.z * 65535 + 0.5f);
+		out.Position[3] = 0;
+		out.Normal = glm::packSnorm3x10_1x2(glm::vec4(in.Normal, 0));
+		out.TexCoords[0] = glm::packHalf1x16(in.TexCoords.x);
+		out.TexCoords[1] = glm::packHalf1x16(in.TexCoords.y);
+	}
+	streams.Format = VertexFormat::Packed;
+	streams.Vertices = packed.data();
+	streams.VertexCount = count;
+	streams.PositionScale = size;
+	streams.PositionOffset = box.Min;
+}
+
+bool Mesh::ShortIndices(const GLuint* indices, GLuint count, GLuint vertexCount, vector<uint16_t>& shortIndices) {
+	if (vertexCount > 0xFFFF) return false;
+	shortIndices.resize(count);
+	for (GLuint i = 0; i < count; i++) {
+		shortIndices[i] = (uint16_t)indices[i];
+	}
+	return true;
 }
\ No newline at end of file
@@ -1,31 +1,103 @@
-#include <glm/glm.hpp>
-#include <GL/glew.h>
-#include <vector>
-
-#include "Shader.h"
-#include "Texture.h"
-#include "LightingInfo.h"
-
-using std::vector;
-
-struct MeshVertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-};
-
-class Mesh {
-public:
-    Mesh();
-    void Import(vector<MeshVertex> vertices, vector<GLuint> indices, vector<Texture2D> textures);
-    void Draw(Shader& shader, LightingInfo& lighting);
-
-    vector<MeshVertex> Vertices;
-    vector<GLuint> Indices;
-    vector<Texture2D> Textures;
-    glm::vec4 DiffuseColor;
-private:
-    unsigned int VBO;
-    unsigned int VAO;
-    unsigned int EBO;
+#pragma once
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+
+#include "Shader.h"
+#include "Texture.h"
+#include "Material.h"
+#include "Culling.h"
+#include "GeometryArena.h"
+
+using std::vector;
+
+// Levels of detail per mesh, the full mesh included
+#define MAX_LODS 4
+
+struct MeshVertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+// Half the size of MeshVertex. Positions are unorm16 across the mesh's
+// bounding box, normals GL_INT_2_10_10_10_REV and texture coordinates halves.
+struct PackedVertex {
+    uint16_t Position[4]; // w is padding
+    uint32_t Normal;
+    uint16_t TexCoords[2];
+};
+
+enum class VertexFormat { Float = 0, Packed = 1 };
+
+// One level of detail, a range of the mesh's index stream over the same vertices
+struct MeshLod {
+    GLuint FirstIndex;
+    GLuint IndexCount;
+    // Largest simplification error, as a fraction of the mesh's size
+    float Error;
+};
+
+// Vertex and index data ready to upload, in either format
+struct MeshStreams {
+    VertexFormat Format = VertexFormat::Float;
+    const void* Vertices = nullptr;
+    GLuint VertexCount = 0;
+    const void* Indices = nullptr;
+    GLuint IndexCount = 0;
+    GLenum IndexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT when every index fits
+    // Packed positions decode as position * PositionScale + PositionOffset
+    glm::vec3 PositionScale = glm::vec3(1);
+    glm::vec3 PositionOffset = glm::vec3(0);
+    // Index ranges of each level of detail. None means the whole stream is one level.
+    const MeshLod* Lods = nullptr;
+    GLuint LodCount = 0;
+
+    size_t VertexBytes() const { return (size_t)VertexCount * (Format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(MeshVertex)); }
+    size_t IndexBytes() const { return (size_t)IndexCount * (IndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint)); }
+};
+
+class Mesh {
+public:
+    Mesh();
+    void Import(vector<MeshVertex> vertices, vector<GLuint> indices, vector<Texture2D> textures, glm::vec4 diffuseColor);
+    // Uploads the streams as they are without keeping a CPU copy, Vertices and Indices stay empty
+    void Import(const MeshStreams& streams, vector<Texture2D> textures, glm::vec4 diffuseColor);
+    // Issues the draw call. The material and vertex array must already be bound.
+    void DrawElements(GLsizei instances = 1, GLuint lod = 0) const;
+    GLuint Triangles(GLuint lod = 0) const { return Lods[lod].IndexCount / 3; }
+    GLuint VertexArray() const { return arena().VertexArray(); }
+    // Identifies the mesh's geometry, for sorting and batching draws
+    GLuint GeometryID() const { return geometry; }
+    // Frees the mesh's space in the arena. Copies of a mesh share it, so only the owner calls this.
+    // Textures belong to the ResourceManager texture cache and are released there.
+    void Release();
+
+    // Quantizes vertices into the packed format. box must contain every position.
+    static void PackVertices(const MeshVertex* vertices, GLuint count, const BoundingBox& box, vector<PackedVertex>& packed, MeshStreams& streams);
+    // Narrows indices to 16 bits if the mesh has few enough vertices. False if they don't fit.
+    static bool ShortIndices(const GLuint* indices, GLuint count, GLuint vertexCount, vector<uint16_t>& shortIndices);
+
+    // Every mesh's vertices and indices live in the arena for its format
+    static GeometryArena Arena;
+    static GeometryArena PackedArena;
+
+    vector<MeshVertex> Vertices;
+    vector<GLuint> Indices;
+    vector<Texture2D> Textures;
+    Material MeshMaterial;
+    // Model space bounds, filled in by the importer
+    BoundingBox Box;
+    BoundingSphere Sphere;
+    // Finest first, always at least one
+    vector<MeshLod> Lods;
+    VertexFormat Format = VertexFormat::Float;
+    // Set as uniforms when drawing, identity unless the positions are packed
+    glm::vec3 PositionScale = glm::vec3(1);
+    glm::vec3 PositionOffset = glm::vec3(0);
+private:
+    GLuint geometry = 0;
+
+    GeometryArena& arena() const { return Format == VertexFormat::Packed ? PackedArena : Arena; }
 };
\ No newline at end of file
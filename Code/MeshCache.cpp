@@ -0,0 +1,310 @@
+#include "MeshCache.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "MappedFile.h"
+#include "Util.h"
+
+const size_t STREAM_ALIGNMENT = 16;
+
+struct CacheHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t SourceHash;
+    uint32_t ImportFlags;
+    uint32_t VertexFormat;
+    uint32_t VertexSize;
+    uint32_t MeshCount;
+    uint32_t TextureCount;
+    uint32_t LampCount;
+    uint32_t LodCount;
+    uint32_t DependencyCount;
+};
+
+struct CacheMesh {
+    uint64_t VertexOffset;
+    uint64_t IndexOffset;
+    uint32_t VertexCount;
+    uint32_t IndexCount;
+    uint32_t FirstTexture;
+    uint32_t TextureCount;
+    uint32_t IndexType;
+    uint32_t FirstLod;
+    uint32_t LodCount;
+    float PositionScale[3];
+    float PositionOffset[3];
+    float DiffuseColor[4];
+    float BoxMin[3];
+    float BoxMax[3];
+    float SphereCenter[3];
+    float SphereRadius;
+};
+
+struct CacheTexture {
+    uint32_t Type;
+    char Path[124];
+};
+
+struct CacheLamp {
+    float Position[3];
+    float Color[3];
+};
+
+struct CacheLod {
+    uint32_t FirstIndex;
+    uint32_t IndexCount;
+    float Error;
+};
+
+// A file other than the source the import read, hash 0 if it couldn't be
+struct CacheDependency {
+    uint64_t Hash;
+    char Path[120];
+};
+
+static size_t vertexSize(VertexFormat format) {
+    return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(MeshVertex);
+}
+
+static size_t indexSize(GLenum type) {
+    return type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint);
+}
+
+static size_t align(size_t offset) {
+    return (offset + STREAM_ALIGNMENT - 1) & ~(STREAM_ALIGNMENT - 1);
+}
+
+string MeshCache::CachePath(const string& source) {
+    return Util::cache_path(source, ".lrmc");
+}
+
+uint64_t MeshCache::SourceHash(const string& source) {
+    MappedFile file;
+    if (!file.Open(source)) return 0;
+    return Util::hash_bytes(file.Data(), file.Size());
+}
+
+bool MeshCache::Load(const string& source, uint64_t sourceHash, uint32_t importFlags, VertexFormat format, PendingModel& model) {
+    auto file = std::make_shared<MappedFile>();
+    if (sourceHash == 0 || !file->Open(CachePath(source))) return false;
+
+    const unsigned char* base = file->Data();
+    size_t size = file->Size();
+    if (size < sizeof(CacheHeader)) return false;
+    const CacheHeader* header = (const CacheHeader*)base;
+    if (header->Magic != MAGIC || header->Version != VERSION || header->VertexSize != vertexSize(format)) return false;
+    if (header->SourceHash != sourceHash || header->ImportFlags != importFlags || header->VertexFormat != (uint32_t)format) {
+        printf("Cooked copy of %s is stale, reimporting\n", source.c_str());
+        return false;
+    }
+
+    size_t tablesEnd = sizeof(CacheHeader)
+        + sizeof(CacheMesh) * header->MeshCount
+        + sizeof(CacheTexture) * header->TextureCount
+        + sizeof(CacheLamp) * header->LampCount
+        + sizeof(CacheLod) * header->LodCount
+        + sizeof(CacheDependency) * header->DependencyCount;
+    if (size < tablesEnd) return false;
+    const CacheMesh* meshes = (const CacheMesh*)(base + sizeof(CacheHeader));
+    const CacheTexture* textures = (const CacheTexture*)(meshes + header->MeshCount);
+    const CacheLamp* lamps = (const CacheLamp*)(textures + header->TextureCount);
+    const CacheLod* lods = (const CacheLod*)(lamps + header->LampCount);
+    const CacheDependency* dependencies = (const CacheDependency*)(lods + header->LodCount);
+
+    // The material library bakes its colours and texture paths into the file too
+    for (uint32_t i=0; i<header->DependencyCount; i++) {
+        string path(dependencies[i].Path, strnlen(dependencies[i].Path, sizeof(dependencies[i].Path)));
+        if (SourceHash(path) != dependencies[i].Hash) {
+            printf("Cooked copy of %s is stale (%s changed), reimporting\n", source.c_str(), path.c_str());
+            return false;
+        }
+    }
+
+    model.Meshes.clear();
+    model.Meshes.resize(header->MeshCount);
+    for (uint32_t i=0; i<header->MeshCount; i++) {
+        const CacheMesh& in = meshes[i];
+        if ((in.IndexType != GL_UNSIGNED_INT && in.IndexType != GL_UNSIGNED_SHORT) ||
+            in.VertexOffset + header->VertexSize * (uint64_t)in.VertexCount > size ||
+            in.IndexOffset + indexSize(in.IndexType) * (uint64_t)in.IndexCount > size ||
+            (uint64_t)in.FirstTexture + in.TextureCount > header->TextureCount ||
+            (uint64_t)in.FirstLod + in.LodCount > header->LodCount || in.LodCount > MAX_LODS) {
+            fprintf(stderr, "Cooked copy of %s is damaged, reimporting\n", source.c_str());
+            model.Meshes.clear();
+            return false;
+        }
+
+        AssimpMesh& out = model.Meshes[i];
+        out.Streams.Format = format;
+        out.Streams.Vertices = base + in.VertexOffset;
+        out.Streams.VertexCount = in.VertexCount;
+        out.Streams.Indices = base + in.IndexOffset;
+        out.Streams.IndexCount = in.IndexCount;
+        out.Streams.IndexType = in.IndexType;
+        out.Streams.PositionScale = glm::vec3(in.PositionScale[0], in.PositionScale[1], in.PositionScale[2]);
+        out.Streams.PositionOffset = glm::vec3(in.PositionOffset[0], in.PositionOffset[1], in.PositionOffset[2]);
+        for (uint32_t l=0; l<in.LodCount; l++) {
+            const CacheLod& lod = lods[in.FirstLod + l];
+            if ((uint64_t)lod.FirstIndex + lod.IndexCount > in.IndexCount) {
+                fprintf(stderr, "Cooked copy of %s is damaged, reimporting\n", source.c_str());
+                model.Meshes.clear();
+                return false;
+            }
+            out.Lods.push_back(MeshLod{ lod.FirstIndex, lod.IndexCount, lod.Error });
+        }
+        out.Streams.Lods = out.Lods.data();
+        out.Streams.LodCount = (GLuint)out.Lods.size();
+        out.DiffuseColor = glm::vec4(in.DiffuseColor[0], in.DiffuseColor[1], in.DiffuseColor[2], in.DiffuseColor[3]);
+        out.Box.Min = glm::vec3(in.BoxMin[0], in.BoxMin[1], in.BoxMin[2]);
+        out.Box.Max = glm::vec3(in.BoxMax[0], in.BoxMax[1], in.BoxMax[2]);
+        out.Sphere.Center = glm::vec3(in.SphereCenter[0], in.SphereCenter[1], in.SphereCenter[2]);
+        out.Sphere.Radius = in.SphereRadius;
+        for (uint32_t t=0; t<in.TextureCount; t++) {
+            const CacheTexture& tex = textures[in.FirstTexture + t];
+            TextureRef ref;
+            ref.Path = string(tex.Path, strnlen(tex.Path, sizeof(tex.Path)));
+            ref.Type = (Texture2D::TextureType)tex.Type;
+            out.Textures.push_back(ref);
+        }
+    }
+
+    model.Lamps.clear();
+    for (uint32_t i=0; i<header->LampCount; i++) {
+        ModelLamp lamp;
+        lamp.Position = glm::vec3(lamps[i].Position[0], lamps[i].Position[1], lamps[i].Position[2]);
+        lamp.Color = glm::vec3(lamps[i].Color[0], lamps[i].Color[1], lamps[i].Color[2]);
+        model.Lamps.push_back(lamp);
+    }
+
+    // Keep the mapping alive until the streams have been uploaded
+    model.Cache = file;
+    return true;
+}
+
+bool MeshCache::Write(const string& source, uint64_t sourceHash, uint32_t importFlags, VertexFormat format, const PendingModel& model) {
+    if (sourceHash == 0) return false;
+
+    CacheHeader header = {};
+    header.Magic = MAGIC;
+    header.Version = VERSION;
+    header.SourceHash = sourceHash;
+    header.ImportFlags = importFlags;
+    header.VertexFormat = (uint32_t)format;
+    header.VertexSize = (uint32_t)vertexSize(format);
+    header.MeshCount = (uint32_t)model.Meshes.size();
+    header.LampCount = (uint32_t)model.Lamps.size();
+
+    vector<CacheDependency> dependencies;
+    for (auto& path : model.Dependencies) {
+        CacheDependency dependency = {};
+        if (path.size() >= sizeof(dependency.Path)) {
+            fprintf(stderr, "Not cooking %s, dependency path too long - %s\n", source.c_str(), path.c_str());
+            return false;
+        }
+        dependency.Hash = SourceHash(path);
+        memcpy(dependency.Path, path.c_str(), path.size());
+        dependencies.push_back(dependency);
+    }
+    header.DependencyCount = (uint32_t)dependencies.size();
+
+    vector<CacheMesh> meshes(model.Meshes.size());
+    vector<CacheTexture> textures;
+    vector<CacheLod> lods;
+    for (size_t i=0; i<model.Meshes.size(); i++) {
+        const AssimpMesh& in = model.Meshes[i];
+        CacheMesh& out = meshes[i];
+        out = {};
+        if (in.Streams.Format != format) return false;
+        out.VertexCount = in.Streams.VertexCount;
+        out.IndexCount = in.Streams.IndexCount;
+        out.IndexType = in.Streams.IndexType;
+        memcpy(out.PositionScale, &in.Streams.PositionScale[0], sizeof(out.PositionScale));
+        memcpy(out.PositionOffset, &in.Streams.PositionOffset[0], sizeof(out.PositionOffset));
+        out.FirstLod = (uint32_t)lods.size();
+        out.LodCount = in.Streams.LodCount;
+        for (GLuint l=0; l<in.Streams.LodCount; l++) {
+            const MeshLod& lod = in.Streams.Lods[l];
+            lods.push_back(CacheLod{ lod.FirstIndex, lod.IndexCount, lod.Error });
+        }
+        out.FirstTexture = (uint32_t)textures.size();
+        out.TextureCount = (uint32_t)in.Textures.size();
+        memcpy(out.DiffuseColor, &in.DiffuseColor[0], sizeof(out.DiffuseColor));
+        memcpy(out.BoxMin, &in.Box.Min[0], sizeof(out.BoxMin));
+        memcpy(out.BoxMax, &in.Box.Max[0], sizeof(out.BoxMax));
+        memcpy(out.SphereCenter, &in.Sphere.Center[0], sizeof(out.SphereCenter));
+        out.SphereRadius = in.Sphere.Radius;
+        for (auto& ref : in.Textures) {
+            CacheTexture tex = {};
+            if (ref.Path.size() >= sizeof(tex.Path)) {
+                fprintf(stderr, "Not cooking %s, texture path too long - %s\n", source.c_str(), ref.Path.c_str());
+                return false;
+            }
+            tex.Type = (uint32_t)ref.Type;
+            memcpy(tex.Path, ref.Path.c_str(), ref.Path.size());
+            textures.push_back(tex);
+        }
+    }
+    header.TextureCount = (uint32_t)textures.size();
+    header.LodCount = (uint32_t)lods.size();
+
+    vector<CacheLamp> lamps;
+    for (auto& lamp : model.Lamps) {
+        CacheLamp out;
+        memcpy(out.Position, &lamp.Position[0], sizeof(out.Position));
+        memcpy(out.Color, &lamp.Color[0], sizeof(out.Color));
+        lamps.push_back(out);
+    }
+
+    // Lay the streams out after the tables
+    size_t offset = sizeof(CacheHeader)
+        + sizeof(CacheMesh) * meshes.size()
+        + sizeof(CacheTexture) * textures.size()
+        + sizeof(CacheLamp) * lamps.size()
+        + sizeof(CacheLod) * lods.size()
+        + sizeof(CacheDependency) * dependencies.size();
+    for (size_t i=0; i<meshes.size(); i++) {
+        offset = align(offset);
+        meshes[i].VertexOffset = offset;
+        offset += model.Meshes[i].Streams.VertexBytes();
+        offset = align(offset);
+        meshes[i].IndexOffset = offset;
+        offset += model.Meshes[i].Streams.IndexBytes();
+    }
+
+    Util::make_directory(Util::CACHE_DIRECTORY);
+    // Written under a temporary name so a half written file is never picked up
+    string path = CachePath(source);
+    string tempPath = path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to write cooked mesh %s\n", path.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (!meshes.empty()) ok = ok && fwrite(&meshes[0], sizeof(CacheMesh), meshes.size(), file) == meshes.size();
+    if (!textures.empty()) ok = ok && fwrite(&textures[0], sizeof(CacheTexture), textures.size(), file) == textures.size();
+    if (!lamps.empty()) ok = ok && fwrite(&lamps[0], sizeof(CacheLamp), lamps.size(), file) == lamps.size();
+    if (!lods.empty()) ok = ok && fwrite(&lods[0], sizeof(CacheLod), lods.size(), file) == lods.size();
+    if (!dependencies.empty()) ok = ok && fwrite(&dependencies[0], sizeof(CacheDependency), dependencies.size(), file) == dependencies.size();
+    const char zeros[STREAM_ALIGNMENT] = {};
+    for (size_t i=0; i<meshes.size() && ok; i++) {
+        const AssimpMesh& in = model.Meshes[i];
+        long position = ftell(file);
+        ok = ok && fwrite(zeros, 1, meshes[i].VertexOffset - position, file) == meshes[i].VertexOffset - position;
+        ok = ok && fwrite(in.Streams.Vertices, 1, in.Streams.VertexBytes(), file) == in.Streams.VertexBytes();
+        position = ftell(file);
+        ok = ok && fwrite(zeros, 1, meshes[i].IndexOffset - position, file) == meshes[i].IndexOffset - position;
+        ok = ok && fwrite(in.Streams.Indices, 1, in.Streams.IndexBytes(), file) == in.Streams.IndexBytes();
+    }
+    ok = (fclose(file) == 0) && ok;
+
+    remove(path.c_str());
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Failed to write cooked mesh %s\n", path.c_str());
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
\ No newline at end of file
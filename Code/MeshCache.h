@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "ResourceManager.h"
+
+using std::string;
+
+// Cooked binary copy of an imported model. Holds the flattened vertex and
+// index streams exactly as Mesh uploads them, so loading one is a file
+// mapping and a glBufferData per mesh instead of an Assimp import.
+//
+// Layout: CacheHeader, CacheMesh[MeshCount], CacheTexture[TextureCount],
+// CacheLamp[LampCount], CacheLod[LodCount], CacheDependency[DependencyCount],
+// then the vertex and index streams (16 byte aligned).
+// A cooked file is only used while its source hash, import flags, version,
+// vertex format and vertex size all match, and every other file the import
+// read (material libraries and the like) still hashes the same. Otherwise the
+// model is imported again. Packed files store the quantized streams, so nothing is repacked.
+class MeshCache
+{
+public:
+    static const uint32_t MAGIC = 0x434D524C; // "LRMC"
+    static const uint32_t VERSION = 5;
+
+    // Cooked files live in Cache/, named after the source path
+    static string CachePath(const string& source);
+    // Hash of the source file's contents, 0 if it can't be read
+    static uint64_t SourceHash(const string& source);
+
+    // Maps the cooked file and points the meshes' streams straight into it.
+    // False if there is no usable cooked file.
+    static bool Load(const string& source, uint64_t sourceHash, uint32_t importFlags, VertexFormat format, PendingModel& model);
+    // Writes the cooked file for a freshly imported model, recording model.Dependencies
+    static bool Write(const string& source, uint64_t sourceHash, uint32_t importFlags, VertexFormat format, const PendingModel& model);
+private:
+    MeshCache() {}
+};
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Tuning from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+const unsigned int FORSYTH_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// How much a vertex wants its triangles drawn next: more if it is near the
+// front of the cache, more again if it has few triangles left
+static float vertexScore(int cachePosition, GLuint remaining) {
+    if (remaining == 0) return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // Used by the last triangle, deliberately lower so strips don't just reverse
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = powf(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+    return score + VALENCE_BOOST_SCALE * powf((float)remaining, -VALENCE_BOOST_POWER);
+}
+
+MeshOptimizer::Stats MeshOptimizer::Optimize(vector<MeshVertex>& vertices, vector<GLuint>& indices, bool overdraw) {
+    Stats stats;
+    GLuint vertexCount = (GLuint)vertices.size();
+    size_t triangles = indices.size() / 3;
+    if (triangles == 0 || vertexCount == 0) return stats;
+
+    vector<bool> used(vertexCount, false);
+    for (GLuint index : indices) used[index] = true;
+    size_t referenced = std::count(used.begin(), used.end(), true);
+
+    unsigned int misses = CacheMisses(indices, vertexCount);
+    stats.ACMRBefore = (float)misses / triangles;
+    stats.ATVRBefore = (float)misses / referenced;
+
+    vector<GLuint> ordered;
+    optimizeVertexCache(indices, vertexCount, ordered);
+    indices.swap(ordered);
+    if (overdraw)
+        optimizeOverdraw(vertices, indices, vertexCount);
+    optimizeVertexFetch(vertices, indices);
+
+    misses = CacheMisses(indices, (GLuint)vertices.size());
+    stats.ACMRAfter = (float)misses / triangles;
+    stats.ATVRAfter = (float)misses / referenced;
+    return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(vector<GLuint>& indices, GLuint vertexCount) {
+    vector<GLuint> ordered;
+    optimizeVertexCache(indices, vertexCount, ordered);
+    indices.swap(ordered);
+}
+
+unsigned int MeshOptimizer::CacheMisses(const vector<GLuint>& indices, GLuint vertexCount, unsigned int cacheSize) {
+    // A vertex is cached while fewer than cacheSize misses have happened since it was loaded
+    vector<unsigned int> loaded(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    unsigned int misses = 0;
+    for (GLuint index : indices) {
+        if (time - loaded[index] > cacheSize) {
+            loaded[index] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+void MeshOptimizer::optimizeVertexCache(const vector<GLuint>& indices, GLuint vertexCount, vector<GLuint>& out) {
+    size_t triangles = indices.size() / 3;
+
+    // Triangles using each vertex, the first remaining[v] of each list are still to be drawn
+    vector<GLuint> remaining(vertexCount, 0);
+    for (GLuint index : indices) remaining[index]++;
+    vector<size_t> offsets(vertexCount + 1, 0);
+    for (GLuint v = 0; v < vertexCount; v++) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    vector<GLuint> adjacency(indices.size());
+    vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = (GLuint)(i / 3);
+    }
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> score(vertexCount);
+    for (GLuint v = 0; v < vertexCount; v++) {
+        score[v] = vertexScore(-1, remaining[v]);
+    }
+    vector<float> triangleScore(triangles);
+    for (size_t t = 0; t < triangles; t++) {
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    }
+    vector<bool> emitted(triangles, false);
+
+    vector<GLuint> cache, nextCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+    out.clear();
+    out.reserve(indices.size());
+
+    size_t cursor = 0;
+    long best = -1;
+    for (size_t drawn = 0; drawn < triangles; drawn++) {
+        if (best < 0) {
+            // Dead end, nothing in the cache has triangles left
+            while (emitted[cursor]) cursor++;
+            best = (long)cursor;
+        }
+        emitted[best] = true;
+
+        // The triangle's vertices move to the front of the cache
+        nextCache.clear();
+        for (int k = 0; k < 3; k++) {
+            GLuint v = indices[best * 3 + k];
+            out.push_back(v);
+            if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+                nextCache.push_back(v);
+            GLuint* first = &adjacency[offsets[v]];
+            GLuint* last = first + remaining[v];
+            GLuint* found = std::find(first, last, (GLuint)best);
+            std::swap(*found, *(last - 1));
+            remaining[v]--;
+        }
+        for (GLuint v : cache) {
+            if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+                nextCache.push_back(v);
+        }
+        // Anything pushed off the end needs its score dropping too
+        for (size_t i = FORSYTH_CACHE_SIZE; i < nextCache.size(); i++) {
+            cachePosition[nextCache[i]] = -1;
+        }
+        for (size_t i = 0; i < nextCache.size() && i < FORSYTH_CACHE_SIZE; i++) {
+            cachePosition[nextCache[i]] = (int)i;
+        }
+
+        // Rescore the touched vertices and their triangles, picking the best one as we go
+        best = -1;
+        float bestScore = -1.0f;
+        for (GLuint v : nextCache) {
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+        for (GLuint v : nextCache) {
+            for (size_t i = offsets[v]; i < offsets[v] + remaining[v]; i++) {
+                GLuint t = adjacency[i];
+                triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = (long)t;
+                }
+            }
+        }
+        if (nextCache.size() > FORSYTH_CACHE_SIZE)
+            nextCache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(nextCache);
+    }
+}
+
+void MeshOptimizer::optimizeOverdraw(const vector<MeshVertex>& vertices, vector<GLuint>& indices, GLuint vertexCount) {
+    // Clusters break wherever the cache order starts afresh, a triangle missing on all three
+    // vertices, so moving whole clusters around costs next to nothing in cache hits
+    struct Cluster {
+        size_t First, Count;
+        float Sort;
+    };
+    vector<Cluster> clusters;
+    vector<unsigned int> loaded(vertexCount, 0);
+    unsigned int time = CACHE_SIZE + 1;
+    size_t triangles = indices.size() / 3;
+    for (size_t t = 0; t < triangles; t++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            GLuint index = indices[t * 3 + k];
+            if (time - loaded[index] > CACHE_SIZE) {
+                loaded[index] = time++;
+                misses++;
+            }
+        }
+        if (misses == 3 || clusters.empty())
+            clusters.push_back(Cluster{ t, 0, 0.0f });
+        clusters.back().Count++;
+    }
+    if (clusters.size() < 2) return;
+
+    // Area weighted centroid and normal per cluster
+    vector<glm::vec3> centroids(clusters.size()), normals(clusters.size());
+    glm::vec3 meshCentroid(0);
+    float meshArea = 0;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        glm::vec3 centroid(0), normal(0);
+        float area = 0;
+        for (size_t t = clusters[c].First; t < clusters[c].First + clusters[c].Count; t++) {
+            const glm::vec3& a = vertices[indices[t * 3]].Position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& p = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 cross = glm::cross(b - a, p - a);
+            float triangleArea = glm::length(cross);
+            centroid += (a + b + p) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        centroids[c] = area > 0 ? centroid / area : vertices[indices[clusters[c].First * 3]].Position;
+        normals[c] = normal;
+        meshCentroid += centroid;
+        meshArea += area;
+    }
+    if (meshArea > 0) meshCentroid /= meshArea;
+
+    // Clusters facing out from the middle of the mesh tend to hide the rest, so they go first
+    for (size_t c = 0; c < clusters.size(); c++) {
+        float length = glm::length(normals[c]);
+        clusters[c].Sort = length > 0 ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.Sort > b.Sort;
+    });
+
+    vector<GLuint> sorted;
+    sorted.reserve(indices.size());
+    for (auto& cluster : clusters) {
+        sorted.insert(sorted.end(), indices.begin() + cluster.First * 3, indices.begin() + (cluster.First + cluster.Count) * 3);
+    }
+    indices.swap(sorted);
+}
+
+void MeshOptimizer::optimizeVertexFetch(vector<MeshVertex>& vertices, vector<GLuint>& indices) {
+    const GLuint UNUSED = ~0u;
+    vector<GLuint> remap(vertices.size(), UNUSED);
+    vector<MeshVertex> ordered;
+    ordered.reserve(vertices.size());
+    for (GLuint& index : indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = (GLuint)ordered.size();
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered);
+}
\ No newline at end of file
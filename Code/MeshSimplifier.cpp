@@ -0,0 +1,254 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include "MeshOptimizer.h"
+
+// Each level aims for this fraction of the triangles of the level before
+const float LOD_RATIO = 0.5f;
+// A level has to drop at least this fraction of the triangles to be kept
+const float LOD_MIN_REDUCTION = 0.25f;
+const size_t LOD_MIN_TRIANGLES = 32;
+// Weight of the planes keeping open borders in place, relative to the faces
+const double BORDER_WEIGHT = 10.0;
+// How much merging differing normals and UVs costs, scaled by the edge length
+const double ATTRIBUTE_WEIGHT = 0.1;
+// Collapses turning a face further than this (cosine of the angle) are refused
+const float FLIP_COSINE = 0.5f;
+
+// Sum of squared distances to a set of weighted planes
+struct Quadric {
+    double a2 = 0, b2 = 0, c2 = 0, d2 = 0;
+    double ab = 0, ac = 0, ad = 0, bc = 0, bd = 0, cd = 0;
+    double Weight = 0;
+
+    Quadric() {}
+    Quadric(glm::vec3 normal, float distance, double weight) {
+        double a = normal.x, b = normal.y, c = normal.z, d = distance;
+        a2 = a * a * weight; b2 = b * b * weight; c2 = c * c * weight; d2 = d * d * weight;
+        ab = a * b * weight; ac = a * c * weight; ad = a * d * weight;
+        bc = b * c * weight; bd = b * d * weight; cd = c * d * weight;
+        Weight = weight;
+    }
+
+    void Add(const Quadric& q) {
+        a2 += q.a2; b2 += q.b2; c2 += q.c2; d2 += q.d2;
+        ab += q.ab; ac += q.ac; ad += q.ad; bc += q.bc; bd += q.bd; cd += q.cd;
+        Weight += q.Weight;
+    }
+
+    // Weighted mean squared distance from p to the planes
+    double Error(glm::vec3 p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double error = a2 * x * x + b2 * y * y + c2 * z * z + d2
+            + 2 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z);
+        return Weight > 0 ? std::fabs(error) / Weight : 0.0;
+    }
+};
+
+struct Collapse {
+    GLuint From, To;
+    double Cost;
+};
+
+static double attributeDistance(const MeshVertex& a, const MeshVertex& b) {
+    glm::vec3 normal = a.Normal - b.Normal;
+    glm::vec2 uv = a.TexCoords - b.TexCoords;
+    return glm::dot(normal, normal) + glm::dot(uv, uv);
+}
+
+float MeshSimplifier::Simplify(const vector<MeshVertex>& vertices, const vector<GLuint>& indices, size_t targetIndexCount, vector<GLuint>& out) {
+    out = indices;
+    GLuint vertexCount = (GLuint)vertices.size();
+    if (indices.size() <= targetIndexCount || vertexCount == 0) return 0.0f;
+
+    // Work in a unit sized space so the error is relative to the mesh
+    glm::vec3 low = vertices[0].Position, high = vertices[0].Position;
+    for (auto& vertex : vertices) {
+        low = glm::min(low, vertex.Position);
+        high = glm::max(high, vertex.Position);
+    }
+    glm::vec3 size = high - low;
+    float extent = std::max(size.x, std::max(size.y, size.z));
+    float scale = extent > 0 ? 1.0f / extent : 1.0f;
+    vector<glm::vec3> positions(vertexCount);
+    for (GLuint v = 0; v < vertexCount; v++) {
+        positions[v] = (vertices[v].Position - low) * scale;
+    }
+
+    // Vertices sharing a position differ in normal or UV, moving them apart would tear the surface
+    vector<GLuint> byPosition(vertexCount);
+    for (GLuint v = 0; v < vertexCount; v++) byPosition[v] = v;
+    std::sort(byPosition.begin(), byPosition.end(), [&](GLuint a, GLuint b) {
+        const glm::vec3& p = positions[a];
+        const glm::vec3& q = positions[b];
+        if (p.x != q.x) return p.x < q.x;
+        if (p.y != q.y) return p.y < q.y;
+        return p.z < q.z;
+    });
+    vector<GLuint> canonical(vertexCount);
+    vector<bool> locked(vertexCount, false);
+    for (GLuint i = 0; i < vertexCount; i++) {
+        GLuint v = byPosition[i];
+        canonical[v] = v;
+        if (i > 0 && positions[byPosition[i - 1]] == positions[v]) {
+            canonical[v] = canonical[byPosition[i - 1]];
+            locked[v] = locked[canonical[v]] = true;
+        }
+    }
+
+    // Face planes, weighted by area
+    vector<Quadric> quadrics(vertexCount);
+    std::unordered_map<uint64_t, int> edgeUses;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const glm::vec3& p0 = positions[indices[i]];
+        glm::vec3 normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+        float area = glm::length(normal);
+        if (area > 0) {
+            normal = normal / area;
+            Quadric plane(normal, -glm::dot(normal, p0), area);
+            for (int k = 0; k < 3; k++) quadrics[indices[i + k]].Add(plane);
+        }
+        for (int k = 0; k < 3; k++) {
+            GLuint a = canonical[indices[i + k]], b = canonical[indices[i + (k + 1) % 3]];
+            edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+        }
+    }
+    // Edges used by a single triangle are open borders, planes at right angles to the face keep them in place
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const glm::vec3& p0 = positions[indices[i]];
+        glm::vec3 faceNormal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+        if (glm::length(faceNormal) == 0) continue;
+        faceNormal = glm::normalize(faceNormal);
+        for (int k = 0; k < 3; k++) {
+            GLuint a = indices[i + k], b = indices[i + (k + 1) % 3];
+            GLuint ca = canonical[a], cb = canonical[b];
+            if (edgeUses[((uint64_t)std::min(ca, cb) << 32) | std::max(ca, cb)] != 1) continue;
+            glm::vec3 edge = positions[b] - positions[a];
+            float length = glm::length(edge);
+            if (length == 0) continue;
+            glm::vec3 normal = glm::normalize(glm::cross(edge, faceNormal));
+            Quadric plane(normal, -glm::dot(normal, positions[a]), BORDER_WEIGHT * length * length);
+            quadrics[a].Add(plane);
+            quadrics[b].Add(plane);
+        }
+    }
+
+    double maxError = 0;
+    vector<GLuint> remap(vertexCount);
+    vector<bool> touched(vertexCount);
+    vector<size_t> offsets(vertexCount + 1);
+    vector<GLuint> adjacency;
+    vector<Collapse> collapses;
+    while (out.size() > targetIndexCount) {
+        // Triangles around each vertex, for the flip test
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (GLuint index : out) offsets[index + 1]++;
+        for (GLuint v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+        adjacency.resize(out.size());
+        vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < out.size(); i++) {
+            adjacency[fill[out[i]]++] = (GLuint)(i / 3);
+        }
+
+        // Cheapest direction of every edge, shared edges show up twice but only one can win
+        collapses.clear();
+        for (size_t i = 0; i < out.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                GLuint a = out[i + k], b = out[i + (k + 1) % 3];
+                Collapse best = { 0, 0, -1.0 };
+                for (int direction = 0; direction < 2; direction++) {
+                    GLuint from = direction == 0 ? a : b, to = direction == 0 ? b : a;
+                    if (locked[from]) continue;
+                    Quadric merged = quadrics[from];
+                    merged.Add(quadrics[to]);
+                    glm::vec3 edge = positions[from] - positions[to];
+                    double cost = merged.Error(positions[to])
+                        + ATTRIBUTE_WEIGHT * glm::dot(edge, edge) * attributeDistance(vertices[from], vertices[to]);
+                    if (best.Cost < 0 || cost < best.Cost)
+                        best = { from, to, cost };
+                }
+                if (best.Cost >= 0) collapses.push_back(best);
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.Cost < b.Cost;
+        });
+
+        for (GLuint v = 0; v < vertexCount; v++) remap[v] = v;
+        std::fill(touched.begin(), touched.end(), false);
+        size_t remaining = out.size();
+        size_t applied = 0;
+        for (auto& collapse : collapses) {
+            if (remaining <= targetIndexCount) break;
+            if (touched[collapse.From] || touched[collapse.To]) continue;
+
+            // Refuse if any triangle that survives the collapse would turn over
+            bool flips = false;
+            size_t removed = 0;
+            for (size_t i = offsets[collapse.From]; i < offsets[collapse.From + 1] && !flips; i++) {
+                const GLuint* triangle = &out[adjacency[i] * 3];
+                if (triangle[0] == collapse.To || triangle[1] == collapse.To || triangle[2] == collapse.To) {
+                    removed++;
+                    continue;
+                }
+                glm::vec3 before[3], after[3];
+                for (int k = 0; k < 3; k++) {
+                    before[k] = positions[triangle[k]];
+                    after[k] = triangle[k] == collapse.From ? positions[collapse.To] : before[k];
+                }
+                glm::vec3 oldNormal = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 newNormal = glm::cross(after[1] - after[0], after[2] - after[0]);
+                // Small turns add up over many collapses, so anything past FLIP_COSINE counts
+                flips = glm::dot(oldNormal, newNormal) <= FLIP_COSINE * glm::length(oldNormal) * glm::length(newNormal);
+            }
+            if (flips) continue;
+
+            remap[collapse.From] = collapse.To;
+            quadrics[collapse.To].Add(quadrics[collapse.From]);
+            // The neighbours stay put for the rest of the pass, or the flip test above would go stale
+            for (size_t i = offsets[collapse.From]; i < offsets[collapse.From + 1]; i++) {
+                const GLuint* triangle = &out[adjacency[i] * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+            }
+            maxError = std::max(maxError, collapse.Cost);
+            remaining -= removed * 3;
+            applied++;
+        }
+        if (applied == 0) break;
+
+        // Apply the collapses, dropping the triangles that fold away
+        size_t write = 0;
+        for (size_t i = 0; i < out.size(); i += 3) {
+            GLuint a = remap[out[i]], b = remap[out[i + 1]], c = remap[out[i + 2]];
+            if (a == b || b == c || a == c) continue;
+            out[write++] = a;
+            out[write++] = b;
+            out[write++] = c;
+        }
+        out.resize(write);
+    }
+    return (float)std::sqrt(maxError);
+}
+
+void MeshSimplifier::BuildLods(const vector<MeshVertex>& vertices, vector<GLuint>& indices, vector<MeshLod>& lods) {
+    lods.clear();
+    lods.push_back(MeshLod{ 0, (GLuint)indices.size(), 0.0f });
+
+    vector<GLuint> previous = indices, level;
+    while (lods.size() < MAX_LODS) {
+        size_t triangles = previous.size() / 3;
+        size_t target = (size_t)(triangles * LOD_RATIO);
+        if (target < LOD_MIN_TRIANGLES) break;
+
+        float error = Simplify(vertices, previous, target * 3, level);
+        if (level.size() / 3 > triangles * (1.0f - LOD_MIN_REDUCTION)) break;
+        MeshOptimizer::OptimizeVertexCache(level, (GLuint)vertices.size());
+
+        lods.push_back(MeshLod{ (GLuint)indices.size(), (GLuint)level.size(), std::max(error, lods.back().Error) });
+        indices.insert(indices.end(), level.begin(), level.end());
+        previous.swap(level);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include "Mesh.h"
+
+using std::vector;
+
+// Builds lower detail versions of imported meshes by quadric error metric
+// edge collapse (Garland and Heckbert). Every collapse moves a vertex onto
+// one of its neighbours, so each level still indexes the original vertex
+// buffer and a mesh's LODs are only extra index ranges. Vertices on normal
+// or UV seams are locked so the attributes stay stitched together, open
+// borders are held in place by extra edge quadrics, and collapses that
+// would flip a triangle over are refused.
+class MeshSimplifier
+{
+public:
+    // Collapses edges until at most targetIndexCount indices are left, or nothing
+    // more can go. Returns the error reached, as a fraction of the mesh's size.
+    static float Simplify(const vector<MeshVertex>& vertices, const vector<GLuint>& indices, size_t targetIndexCount, vector<GLuint>& out);
+    // Appends coarser index lists to indices, each about half the triangles of the
+    // one before, and describes every level in lods with the full mesh first
+    static void BuildLods(const vector<MeshVertex>& vertices, vector<GLuint>& indices, vector<MeshLod>& lods);
+private:
+    MeshSimplifier() {}
+};
\ No newline at end of file
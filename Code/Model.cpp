@@ -1,112 +1,166 @@
-#include "Model.h"
-
-#include <assimp/Importer.hpp>
-#include <assimp/postprocess.h>
-#include <glm/gtc/type_ptr.hpp>
-#include <glm/gtx/quaternion.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-
-#include "ResourceManager.h"
-
-#define USE_EXAMPLE_LAMPS
-#define EXAMPLE_LAMPS_MOVE
-
-Model::Model() {
-
-}
-
-Model::Model(const string& meshname) {
-    SetShader("material");
-    auto data = ResourceManager::GetModelData(meshname);
-    meshes = data.meshes;
-    lamps = data.lamps;
-    Init();
-}
-
-Model::Model(const string& meshname, vec3 position) : Position(position) {
-    SetShader("material");
-    auto data = ResourceManager::GetModelData(meshname);
-    meshes = data.meshes;
-    lamps = data.lamps;
-    Init();
-}
-
-Model::Model(const string& meshname, vec3 position, vec3 rotation, vec3 size)
- : Position(position), Rotation(rotation), Size(size) {
-    Rotation = glm::radians(Rotation);
-    SetShader("material");
-    auto data = ResourceManager::GetModelData(meshname);
-    meshes = data.meshes;
-    lamps = data.lamps;
-    Init();
-}
-
-void Model::Init() {
-    #ifdef USE_EXAMPLE_LAMPS
-    lamps.clear();
-    lamps.push_back(ModelLamp {
-        glm::vec3(1.2f, 1.0f, 2.0f),
-        glm::vec4(0,1,0,1)
-    });
-    lamps.push_back(ModelLamp {
-        glm::vec3(1.2f, 1.0f, 2.0f),
-        glm::vec4(1,0,0,1)
-    });
-    lamps.push_back(ModelLamp {
-        glm::vec3(1.2f, 1.0f, 2.0f),
-        glm::vec4(0.2,0.2,1,1)
-    });
-    #endif
-}
-
-void Model::SetShader(string name) {
-    shader = ResourceManager::GetShader(name);
-}
-
-void Model::Update(GLfloat dt) {
-    #ifdef USE_EXAMPLE_LAMPS
-    #ifdef EXAMPLE_LAMPS_MOVE
-    const glm::vec3 UP = glm::vec3(0.0f, 1.0f, 0.0f);
-	lamps[0].Position = glm::vec3(glm::mat4_cast(glm::angleAxis(5*dt, UP)) * glm::vec4(lamps[0].Position, 1));
-	lamps[1].Position = glm::vec3(glm::mat4_cast(glm::angleAxis(-3*dt, UP)) * glm::vec4(lamps[1].Position, 1));
-	lamps[2].Position = glm::vec3(glm::mat4_cast(glm::angleAxis(8*dt, UP)) * glm::vec4(lamps[2].Position, 1));
-    #endif
-    #endif
-}
-
-void Model::Draw(glm::mat4 projection, glm::mat4 view, glm::vec3 viewPos) {
-    shader.Use();
-
-	currentModel = glm::mat4(1.0);
-	currentModel = glm::scale(currentModel, Size);
-	currentModel = glm::translate(currentModel, Position);
-	glm::quat rot = glm::quat(Rotation);
-	currentModel *= glm::toMat4(rot);
-    
-    LightingInfo lighting;
-    for (int i=0; i<MAX_LIGHTS; i++) {
-        if (i < lamps.size()) {
-            lighting.LightActive[i] = true;
-            lighting.LightColor[i] = glm::vec4(lamps[i].Color, 1);
-            lighting.LightPos[i] = glm::vec4(lamps[i].Position + Position ,1);
-            lighting.SpecularStrength[i] = 0.5f;
-        } else {
-            lighting.LightActive[i] = false;
-        }
-    }
-    
-    lighting.AmbientColor = glm::vec4(1);
-    lighting.AmbientStrength = 0.2f;
-    lighting.ViewPos = viewPos;
-	//auto pvm = projection * view * currentModel;
-    //shader.SetMatrix4("pvm", pvm);
-
-    auto proj_view = projection * view;
-
-    shader.SetMatrix4("pv", &proj_view);
-    shader.SetMatrix4("model", &currentModel);
-	
-    for (Mesh mesh : meshes) {
-	    mesh.Draw(shader, lighting);
-    }
+#include "Model.h"
+
+#include <algorithm>
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "ResourceManager.h"
+
+#define USE_EXAMPLE_LAMPS
+#define EXAMPLE_LAMPS_MOVE
+
+float Model::LodScreenSizes[MAX_LODS - 1] = { 0.25f, 0.12f, 0.06f };
+float Model::LodHysteresis = 0.15f;
+float Model::LampRange = 10.0f;
+TransformSystem& Model::Transforms() {
+    static TransformSystem transforms;
+    return transforms;
+}
+
+Model::Model() : transform(Transforms().Create()) {
+
+}
+
+Model::Model(const string& meshname) : transform(Transforms().Create()) {
+    Init(meshname);
+}
+
+Model::Model(const string& meshname, vec3 position) : transform(Transforms().Create(position)) {
+    Init(meshname);
+}
+
+Model::Model(const string& meshname, vec3 position, vec3 rotation, vec3 size)
+ : transform(Transforms().Create(position, glm::radians(rotation), size)) {
+    Init(meshname);
+}
+
+Model::~Model() {
+    Transforms().Destroy(transform);
+}
+
+void Model::Init(const string& meshname) {
+    SetShader("material");
+    modelName = meshname;
+    IsReady();
+
+    #ifdef USE_EXAMPLE_LAMPS
+    lamps.clear();
+    lamps.push_back(ModelLamp {
+        glm::vec3(1.2f, 1.0f, 2.0f),
+        glm::vec4(0,1,0,1)
+    });
+    lamps.push_back(ModelLamp {
+        glm::vec3(1.2f, 1.0f, 2.0f),
+        glm::vec4(1,0,0,1)
+    });
+    lamps.push_back(ModelLamp {
+        glm::vec3(1.2f, 1.0f, 2.0f),
+        glm::vec4(0.2,0.2,1,1)
+    });
+    #endif
+}
+
+bool Model::IsReady() {
+    if (!data && !modelName.empty()) {
+        data = ResourceManager::GetModelData(modelName);
+        #ifndef USE_EXAMPLE_LAMPS
+        if (data)
+            lamps = data->lamps;
+        #endif
+    }
+    return (bool)data;
+}
+
+void Model::SetShader(string name) {
+    shaderName = name;
+    shaders.clear();
+}
+
+MaterialShader* Model::shaderVariant(GLuint features) {
+    auto found = shaders.find(features);
+    if (found != shaders.end())
+        return &found->second;
+    Shader program;
+    if (!ResourceManager::RequestShaderVariant(shaderName, features, program))
+        return nullptr;
+    MaterialShader& shader = shaders[features];
+    shader.Set(program);
+    return &shader;
+}
+
+void Model::Update(GLfloat dt) {
+    #ifdef USE_EXAMPLE_LAMPS
+    #ifdef EXAMPLE_LAMPS_MOVE
+    const glm::vec3 UP = glm::vec3(0.0f, 1.0f, 0.0f);
+	lamps[0].Position = glm::vec3(glm::mat4_cast(glm::angleAxis(5*dt, UP)) * glm::vec4(lamps[0].Position, 1));
+	lamps[1].Position = glm::vec3(glm::mat4_cast(glm::angleAxis(-3*dt, UP)) * glm::vec4(lamps[1].Position, 1));
+	lamps[2].Position = glm::vec3(glm::mat4_cast(glm::angleAxis(8*dt, UP)) * glm::vec4(lamps[2].Position, 1));
+    #endif
+    #endif
+}
+
+void Model::PrepareLighting(LightClusters& lights) {
+    glm::vec3 position = GetPosition();
+    for (auto& lamp : lamps) {
+        // Lamps sit relative to the model's position, they don't turn or scale with it
+        PointLight light;
+        light.Position = position + lamp.Position;
+        light.Range = LampRange;
+        light.Color = lamp.Color;
+        light.Specular = 0.5f;
+        lights.Add(light);
+    }
+}
+
+bool Model::GetWorldSphere(BoundingSphere& sphere) const {
+    if (!data) return false;
+    sphere = data->Sphere.Transformed(Transforms().World(transform));
+    return true;
+}
+
+void Model::Submit(RenderQueue& queue, Culler& culler, GLuint lightingSlot) {
+    if (!data) return;
+
+    const glm::mat4& world = Transforms().World(transform);
+    GLuint queued = queue.AddTransform(world, Transforms().Normal(transform));
+    // The model as a whole already passed, only single meshes are worth testing again
+    bool testMeshes = data->meshes.size() > 1;
+    bool instancing = (ResourceManager::ShaderFeatures(shaderName) & SHADER_INSTANCED) != 0;
+    if (meshLods.size() != data->meshes.size())
+        meshLods.assign(data->meshes.size(), 0);
+    for (size_t i = 0; i < data->meshes.size(); i++) {
+        const Mesh& mesh = data->meshes[i];
+        if (testMeshes && !culler.TestBox(mesh.Box.Transformed(world)))
+            continue;
+        float screenSize = queue.ScreenSize(mesh.Sphere.Transformed(world));
+        meshLods[i] = selectLod(mesh, screenSize, meshLods[i]);
+        // The tightest variant for the mesh's material, untextured meshes skip the samplers entirely
+        GLuint features = mesh.MeshMaterial.Features;
+        MaterialShader* shader = shaderVariant(features);
+        MaterialShader* instanced = instancing ? shaderVariant(features | SHADER_INSTANCED) : nullptr;
+        // Until its variant has built the mesh draws untextured with the plain one,
+        // which LoadShader always builds up front, and without instancing
+        if (shader == nullptr) {
+            shader = shaderVariant(0);
+            instanced = nullptr;
+        }
+        if (shader == nullptr)
+            continue;
+        queue.Submit(*shader, instanced, mesh, lightingSlot, queued, meshLods[i]);
+    }
+}
+
+GLuint Model::selectLod(const Mesh& mesh, float screenSize, GLuint current) {
+    GLuint levels = (GLuint)mesh.Lods.size();
+    GLuint lod = std::min(current, levels - 1);
+    // Only move once the size is clearly past the threshold, in either direction
+    while (lod + 1 < levels && screenSize < LodScreenSizes[lod] * (1.0f - LodHysteresis))
+        lod++;
+    while (lod > 0 && screenSize > LodScreenSizes[lod - 1] * (1.0f + LodHysteresis))
+        lod--;
+    return lod;
 }
\ No newline at end of file
@@ -1,39 +1,79 @@
-#pragma once
-#include <string>
-#include <vector>
-#include <GL/glew.h>
-#include <glm/glm.hpp>
-
-#include "Shader.h"
-#include "ResourceManager.h"
-#include "LightingInfo.h"
-
-using std::string;
-using std::vector;
-using glm::vec3;
-
-class Model {
-public:
-    Model();
-    Model(const string& mesh);
-    Model(const string& mesh, vec3 position);
-    Model(const string& mesh, vec3 position, vec3 rotation, vec3 size);
-
-    virtual void Draw(glm::mat4 projection, glm::mat4 view, glm::vec3 viewPos);
-	virtual void Update(GLfloat dt);
-
-    void SetShader(string name);
-
-    glm::vec3 Position = glm::vec3(0);
-    glm::vec3 Rotation = glm::vec3(0);
-    glm::vec3 Size = glm::vec3(1);
-protected:
-    glm::highp_mat4 currentModel;
-    vector<Mesh> meshes;
-    vector<ModelLamp> lamps;
-private:
-    unsigned int VBO, VAO, EBO;
-    Shader shader;
-
-    void Init();
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "ResourceManager.h"
+#include "LightClusters.h"
+#include "RenderQueue.h"
+#include "Culling.h"
+#include "TransformSystem.h"
+
+using std::string;
+using std::vector;
+using glm::vec3;
+
+class Model {
+public:
+    Model();
+    Model(const string& mesh);
+    Model(const string& mesh, vec3 position);
+    Model(const string& mesh, vec3 position, vec3 rotation, vec3 size);
+    virtual ~Model();
+    // Each model owns a slot in Transforms
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    // Adds this model's lamps to the frame's scene lights
+    virtual void PrepareLighting(LightClusters& lights);
+    // World space bounds, valid after Transforms has been updated. False if there is nothing to draw.
+    bool GetWorldSphere(BoundingSphere& sphere) const;
+    // Adds a draw packet per visible mesh to the queue, lit by the given lighting slot
+    virtual void Submit(RenderQueue& queue, Culler& culler, GLuint lightingSlot);
+	virtual void Update(GLfloat dt);
+
+    // Meshes are drawn with the variant of this shader that matches their material
+    void SetShader(string name);
+    // Picks up the model data once an async load has published it. False until then.
+    bool IsReady();
+
+    // Rotation is in radians. Changes show up once Transforms has been updated.
+    glm::vec3 GetPosition() const { return Transforms().GetPosition(transform); }
+    glm::vec3 GetRotation() const { return Transforms().GetRotation(transform); }
+    glm::vec3 GetSize() const { return Transforms().GetSize(transform); }
+    void SetPosition(glm::vec3 position) { Transforms().SetPosition(transform, position); }
+    void SetRotation(glm::vec3 rotation) { Transforms().SetRotation(transform, rotation); }
+    void SetSize(glm::vec3 size) { Transforms().SetSize(transform, size); }
+
+    // Every model's transform, updated once per frame before culling. Created on
+    // first use so it outlives any model destroyed during static teardown.
+    static TransformSystem& Transforms();
+
+    // Screen size, as a fraction of the viewport height, below which each coarser level of detail takes over
+    static float LodScreenSizes[MAX_LODS - 1];
+    // How far past a threshold a mesh has to get before its level changes, stops levels flickering at the boundary
+    static float LodHysteresis;
+    // Distance at which a model's lamps fade out
+    static float LampRange;
+protected:
+    TransformId transform;
+    string modelName;
+    // Shared with every other instance of the same model
+    ModelHandle data;
+    // Per-instance copy, the example lamps move independently
+    vector<ModelLamp> lamps;
+    // Level of detail each mesh was drawn at last frame
+    vector<GLuint> meshLods;
+private:
+    string shaderName;
+    // Variants of the shader in use so far, by SHADER_* features
+    std::map<GLuint, MaterialShader> shaders;
+
+    void Init(const string& meshname);
+    // Null until the variant has finished building
+    MaterialShader* shaderVariant(GLuint features);
+    static GLuint selectLod(const Mesh& mesh, float screenSize, GLuint current);
 };
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "Profiler.h"
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    // Atomic so the reader can safely race a writer that has lapped it, relaxed
+    // access compiles to plain moves
+    struct Event {
+        std::atomic<const char*> Name;
+        std::atomic<int64_t> Start;
+        std::atomic<int64_t> End;
+    };
+
+    // One thread's zones. Only the owning thread writes Events and Head, only
+    // NextFrame reads them and moves Tail.
+    struct ThreadBuffer {
+        std::string Name;
+        uint32_t Id = 0;
+        std::unique_ptr<Event[]> Events;
+        std::atomic<uint64_t> Head;
+        uint64_t Tail = 0;
+
+        ThreadBuffer() : Events(new Event[Profiler::RING_EVENTS]), Head(0) {}
+    };
+
+    struct CapturedZone {
+        const char* Name;
+        int64_t Start;
+        int64_t End;
+        uint32_t Thread; // 0 is the GPU
+    };
+
+    // Timestamp query pairs for one frame's GPU zones
+    struct GpuFrame {
+        GLuint Queries[Profiler::MAX_GPU_ZONES * 2];
+        const char* Names[Profiler::MAX_GPU_ZONES];
+        int Count = 0;
+        GLuint LastQuery = 0; // Issued last, zones nest so this isn't always the last in the array
+        int64_t Offset = 0; // CPU clock minus GPU clock at the start of the frame
+        bool Pending = false;
+    };
+
+    enum class CaptureState { Idle, Recording, Flushing };
+
+    // Everything that needs a constructor run lives in here, behind an accessor.
+    // Worker threads register themselves as soon as they start, which for a
+    // global JobSystem could be before this file's globals were initialised.
+    struct Registry {
+        // Buffers outlive their threads, a capture may still hold zones from one that has exited
+        std::vector<std::unique_ptr<ThreadBuffer>> ThreadBuffers;
+        std::mutex Mutex;
+        std::string CapturePath;
+        std::vector<CapturedZone> Captured;
+    };
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    thread_local ThreadBuffer* currentBuffer = nullptr;
+
+    CaptureState state = CaptureState::Idle;
+    int captureFrames = 0;
+    int framesLeft = 0;
+    int64_t captureStart = 0;
+    int64_t frameStart = 0;
+    size_t gpuZones = 0;
+    size_t dropped = 0; // Lost to a full ring or a GPU result that wasn't back in time
+
+    GpuFrame gpuFrames[Profiler::GPU_LATENCY];
+    int gpuSlot = 0;
+    bool gpuReady = false;
+
+    ThreadBuffer* threadBuffer()
+    {
+        if (currentBuffer == nullptr) {
+            Registry& reg = registry();
+            std::lock_guard<std::mutex> lock(reg.Mutex);
+            reg.ThreadBuffers.emplace_back(new ThreadBuffer());
+            currentBuffer = reg.ThreadBuffers.back().get();
+            currentBuffer->Id = (uint32_t)reg.ThreadBuffers.size();
+            currentBuffer->Name = "Thread " + std::to_string(currentBuffer->Id);
+        }
+        return currentBuffer;
+    }
+
+    void writeJsonString(FILE* file, const std::string& text)
+    {
+        fputc('"', file);
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                fputc('\\', file);
+            fputc(c, file);
+        }
+        fputc('"', file);
+    }
+}
+
+std::atomic<bool> Profiler::active(false);
+
+void Profiler::SetThreadName(const std::string& name)
+{
+    Registry& reg = registry();
+    ThreadBuffer* buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(reg.Mutex);
+    buffer->Name = name;
+}
+
+void Profiler::StartCapture(int frames, const std::string& path)
+{
+    Registry& reg = registry();
+    if (state != CaptureState::Idle) {
+        printf("Profiler capture already running, not starting another\n");
+        return;
+    }
+    if (!gpuReady && (GLEW_VERSION_3_3 || GLEW_ARB_timer_query)) {
+        for (auto& frame : gpuFrames)
+            glGenQueries(MAX_GPU_ZONES * 2, frame.Queries);
+        gpuReady = true;
+    }
+    reg.Captured.clear();
+    gpuZones = 0;
+    dropped = 0;
+    reg.CapturePath = path;
+    captureFrames = std::max(frames, 1);
+    framesLeft = captureFrames;
+    captureStart = Now();
+    frameStart = captureStart;
+    // GPU zones count from the current frame on
+    GpuFrame& current = gpuFrames[gpuSlot];
+    if (gpuReady && !current.Pending) {
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        current.Count = 0;
+        current.Offset = Now() - gpuNow;
+        current.Pending = true;
+    }
+    state = CaptureState::Recording;
+    active.store(true);
+    printf("Profiler capturing %d frames\n", captureFrames);
+}
+
+bool Profiler::Capturing()
+{
+    return state != CaptureState::Idle;
+}
+
+void Profiler::NextFrame()
+{
+    int64_t now = Now();
+    if (state == CaptureState::Recording)
+        RecordCpu("Frame", frameStart, now);
+    frameStart = now;
+
+    // Zones still open when recording stopped arrive while flushing
+    bool keep = state != CaptureState::Idle;
+    drainThreads(keep);
+    // The oldest slot is reused for this frame, read what it holds first
+    gpuSlot = (gpuSlot + 1) % GPU_LATENCY;
+    resolveGpu(gpuSlot);
+
+    if (state == CaptureState::Recording && --framesLeft <= 0) {
+        active.store(false);
+        state = CaptureState::Flushing;
+        framesLeft = GPU_LATENCY;
+    } else if (state == CaptureState::Flushing && --framesLeft <= 0) {
+        writeTrace();
+        state = CaptureState::Idle;
+    }
+
+    GpuFrame& frame = gpuFrames[gpuSlot];
+    frame.Count = 0;
+    frame.Pending = gpuReady && Active();
+    if (frame.Pending) {
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        frame.Offset = Now() - gpuNow;
+    }
+}
+
+int64_t Profiler::Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::RecordCpu(const char* name, int64_t start, int64_t end)
+{
+    ThreadBuffer* buffer = threadBuffer();
+    uint64_t head = buffer->Head.load(std::memory_order_relaxed);
+    Event& event = buffer->Events[head % RING_EVENTS];
+    event.Name.store(name, std::memory_order_relaxed);
+    event.Start.store(start, std::memory_order_relaxed);
+    event.End.store(end, std::memory_order_relaxed);
+    buffer->Head.store(head + 1, std::memory_order_release);
+}
+
+int Profiler::BeginGpu(const char* name)
+{
+    GpuFrame& frame = gpuFrames[gpuSlot];
+    if (!frame.Pending)
+        return -1;
+    if (frame.Count == MAX_GPU_ZONES) {
+        dropped++;
+        return -1;
+    }
+    int zone = frame.Count++;
+    frame.Names[zone] = name;
+    frame.LastQuery = frame.Queries[zone * 2];
+    glQueryCounter(frame.LastQuery, GL_TIMESTAMP);
+    return zone;
+}
+
+void Profiler::EndGpu(int zone)
+{
+    GpuFrame& frame = gpuFrames[gpuSlot];
+    frame.LastQuery = frame.Queries[zone * 2 + 1];
+    glQueryCounter(frame.LastQuery, GL_TIMESTAMP);
+}
+
+void Profiler::drainThreads(bool keep)
+{
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.Mutex);
+    for (auto& buffer : reg.ThreadBuffers) {
+        uint64_t head = buffer->Head.load(std::memory_order_acquire);
+        if (head == buffer->Tail)
+            continue;
+        // A thread that got more than a ring ahead has overwritten its oldest zones
+        uint64_t first = std::max(buffer->Tail, head > RING_EVENTS ? head - RING_EVENTS : 0);
+        size_t before = reg.Captured.size();
+        if (keep) {
+            for (uint64_t i = first; i < head; i++) {
+                const Event& event = buffer->Events[i % RING_EVENTS];
+                reg.Captured.push_back({ event.Name.load(std::memory_order_relaxed), event.Start.load(std::memory_order_relaxed),
+                    event.End.load(std::memory_order_relaxed), buffer->Id });
+            }
+            // The thread kept writing while we copied, anything it could have
+            // overwritten in that time can't be trusted
+            uint64_t after = buffer->Head.load(std::memory_order_acquire) + 1;
+            uint64_t safe = after > RING_EVENTS ? after - RING_EVENTS : 0;
+            if (safe > first) {
+                size_t lost = (size_t)std::min(safe - first, head - first);
+                reg.Captured.erase(reg.Captured.begin() + before, reg.Captured.begin() + before + lost);
+                dropped += lost;
+            }
+            dropped += (size_t)(first - buffer->Tail);
+        }
+        buffer->Tail = head;
+    }
+}
+
+void Profiler::resolveGpu(int slot)
+{
+    Registry& reg = registry();
+    GpuFrame& frame = gpuFrames[slot];
+    if (!frame.Pending)
+        return;
+    frame.Pending = false;
+    if (frame.Count == 0)
+        return;
+    // Queries finish in the order they were issued, so the last one issued being
+    // back means they all are. With nested zones that's the outermost zone's end.
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(frame.LastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available != GL_TRUE) {
+        dropped += frame.Count;
+        return;
+    }
+    for (int i = 0; i < frame.Count; i++) {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frame.Queries[i * 2], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.Queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+        reg.Captured.push_back({ frame.Names[i], (int64_t)begin + frame.Offset, (int64_t)end + frame.Offset, 0 });
+        gpuZones++;
+    }
+}
+
+void Profiler::writeTrace()
+{
+    Registry& reg = registry();
+    FILE* file = fopen(reg.CapturePath.c_str(), "w");
+    if (file == nullptr) {
+        printf("Failed to write profile capture to %s\n", reg.CapturePath.c_str());
+        return;
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+    {
+        std::lock_guard<std::mutex> lock(reg.Mutex);
+        for (auto& buffer : reg.ThreadBuffers) {
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", buffer->Id);
+            writeJsonString(file, buffer->Name);
+            fprintf(file, "}}");
+        }
+    }
+    // Complete events, timestamps in microseconds from the start of the capture
+    for (const CapturedZone& zone : reg.Captured) {
+        if (zone.End < captureStart)
+            continue;
+        int64_t start = std::max(zone.Start, captureStart);
+        fprintf(file, ",\n{\"name\":");
+        writeJsonString(file, zone.Name);
+        fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            zone.Thread, (start - captureStart) / 1000.0, (zone.End - start) / 1000.0);
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("Wrote profile of %d frames to %s - CPU zones: %zu, GPU zones: %zu, dropped: %zu\n",
+        captureFrames, reg.CapturePath.c_str(), reg.Captured.size() - gpuZones, gpuZones, dropped);
+    reg.Captured.clear();
+    reg.Captured.shrink_to_fit();
+}
\ No newline at end of file
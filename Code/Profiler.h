@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Frame profiler. PROFILE_ZONE times the enclosing scope on the CPU and
+// PROFILE_GPU_ZONE times the GL commands issued inside it. Nothing is recorded
+// until a capture is started, so outside of one a zone costs a relaxed atomic
+// load. Every thread writes its zones into its own ring buffer without locking,
+// and NextFrame drains them on the main thread. GPU zones are GL_TIMESTAMP query
+// pairs read back GPU_LATENCY frames later. Results that still aren't available
+// by then are dropped rather than waited on. A finished capture is written out as
+// Chrome trace JSON, for chrome://tracing or Perfetto.
+// Define NO_PROFILER to compile the zones out entirely.
+class Profiler
+{
+public:
+    static const size_t RING_EVENTS = 16384; // Per thread, drained every frame
+    static const int GPU_LATENCY = 4; // Frames between issuing GPU queries and reading them back
+    static const int MAX_GPU_ZONES = 64; // Per frame
+
+    // Names the calling thread in captures
+    static void SetThreadName(const std::string& name);
+    // Records the next frames, then writes them to path as a Chrome trace. Needs a GL context for the GPU zones.
+    static void StartCapture(int frames, const std::string& path);
+    // True from StartCapture until the trace has been written
+    static bool Capturing();
+    // Marks a frame boundary: drains every thread's zones, reads back finished GPU
+    // queries and moves the capture along. Call once a frame on the GL thread.
+    static void NextFrame();
+
+    // Used by the zone classes
+    static bool Active() { return active.load(std::memory_order_relaxed); }
+    static int64_t Now();
+    // name must outlive the capture, zone names are string literals
+    static void RecordCpu(const char* name, int64_t start, int64_t end);
+    // GL thread only. Returns the zone to pass to EndGpu, or -1 if it isn't being recorded.
+    static int BeginGpu(const char* name);
+    static void EndGpu(int zone);
+private:
+    Profiler() {}
+
+    static std::atomic<bool> active;
+
+    static void drainThreads(bool keep);
+    static void resolveGpu(int slot);
+    static void writeTrace();
+};
+
+// Times its own lifetime
+class ProfileZone
+{
+public:
+    ProfileZone(const char* name) : name(name), start(Profiler::Active() ? Profiler::Now() : -1) {}
+    ~ProfileZone() {
+        if (start >= 0)
+            Profiler::RecordCpu(name, start, Profiler::Now());
+    }
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+private:
+    const char* name;
+    int64_t start;
+};
+
+// Times the GL commands issued during its lifetime
+class ProfileGpuZone
+{
+public:
+    ProfileGpuZone(const char* name) : zone(Profiler::Active() ? Profiler::BeginGpu(name) : -1) {}
+    ~ProfileGpuZone() {
+        if (zone >= 0)
+            Profiler::EndGpu(zone);
+    }
+    ProfileGpuZone(const ProfileGpuZone&) = delete;
+    ProfileGpuZone& operator=(const ProfileGpuZone&) = delete;
+private:
+    int zone;
+};
+
+#ifndef NO_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) ProfileGpuZone PROFILE_CONCAT(profileGpuZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_GPU_ZONE(name) ((void)0)
+#endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "ProgramCache.h"
+#include "MappedFile.h"
+#include "Util.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+struct CacheHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t Key;
+    uint32_t Format; // Driver specific binary format
+    uint32_t Length;
+};
+
+ProgramCache::Stats ProgramCache::LoadStats;
+
+bool ProgramCache::Supported() {
+    static int supported = -1;
+    if (supported < 0) {
+        GLint formats = 0;
+        if (GLEW_ARB_get_program_binary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        // Some drivers expose the extension without any formats to go with it
+        supported = formats > 0 ? 1 : 0;
+    }
+    return supported == 1;
+}
+
+uint64_t ProgramCache::Key(const string& vertex, const string& fragment, const string& geometry) {
+    // A binary is only any good to the driver that built it
+    static uint64_t driverHash = 0;
+    if (driverHash == 0) {
+        driverHash = Util::HASH_SEED;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const char* value = (const char*)glGetString(name);
+            if (value != nullptr)
+                driverHash = Util::hash_bytes(value, strlen(value), driverHash);
+        }
+    }
+    uint64_t hash = driverHash;
+    // Lengths go in too, so moving text between stages changes the key
+    for (const string* source : { &vertex, &fragment, &geometry }) {
+        uint64_t length = source->size();
+        hash = Util::hash_bytes(&length, sizeof(length), hash);
+        hash = Util::hash_bytes(source->data(), source->size(), hash);
+    }
+    return hash;
+}
+
+string ProgramCache::CachePath(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "program_%016llx", (unsigned long long)key);
+    return Util::cache_path(name, ".lrpb");
+}
+
+bool ProgramCache::Load(uint64_t key, GLuint program) {
+    MappedFile file;
+    if (!file.Open(CachePath(key))) return false;
+    if (file.Size() < sizeof(CacheHeader)) return false;
+    const CacheHeader* header = (const CacheHeader*)file.Data();
+    if (header->Magic != MAGIC || header->Version != VERSION || header->Key != key) return false;
+    if (file.Size() < sizeof(CacheHeader) + header->Length) return false;
+
+    glProgramBinary(program, header->Format, file.Data() + sizeof(CacheHeader), (GLsizei)header->Length);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE) {
+        // The driver changed underneath us in a way its strings don't show, don't try this one again
+        file.Close();
+        remove(CachePath(key).c_str());
+        LoadStats.Rejected++;
+        return false;
+    }
+    return true;
+}
+
+bool ProgramCache::Write(uint64_t key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return false;
+    std::vector<unsigned char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+    CacheHeader header = {};
+    header.Magic = MAGIC;
+    header.Version = VERSION;
+    header.Key = key;
+    header.Format = format;
+    header.Length = (uint32_t)length;
+
+    Util::make_directory(Util::CACHE_DIRECTORY);
+    // Written under a temporary name so a half written file is never picked up
+    string path = CachePath(key);
+    string tempPath = path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to write program binary %s\n", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(&binary[0], 1, (size_t)length, file) == (size_t)length;
+    ok = (fclose(file) == 0) && ok;
+
+    remove(path.c_str());
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Failed to write program binary %s\n", path.c_str());
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
\ No newline at end of file
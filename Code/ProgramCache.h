@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <GL/glew.h>
+
+using std::string;
+
+// On-disk cache of linked shader programs, through GL_ARB_get_program_binary.
+// Binaries are keyed by a hash of every stage's source (after the feature
+// defines go in) and the driver's vendor, renderer and version strings, so
+// a driver update or a source change just misses. A binary the driver
+// still rejects is deleted and the program compiled from source as usual.
+//
+// Layout: CacheHeader, then the driver's binary blob.
+class ProgramCache
+{
+public:
+    static const uint32_t MAGIC = 0x42504C; // "LPB"
+    static const uint32_t VERSION = 1;
+
+    // Totals since startup, compiled programs are the cold path and cached ones the warm
+    struct Stats {
+        GLuint Compiled = 0;
+        GLuint Loaded = 0;
+        GLuint Rejected = 0; // Binaries found but refused by the driver
+        double CompileMs = 0; // Time the GL thread spent on it, not the time the driver took in the background
+        double LoadMs = 0;
+    };
+    static Stats LoadStats;
+
+    // False if the driver can't hand out program binaries. Needs a GL context.
+    static bool Supported();
+    static uint64_t Key(const string& vertex, const string& fragment, const string& geometry);
+    // Cached binaries live in Cache/, named after the key
+    static string CachePath(uint64_t key);
+
+    // Loads the cached binary into program. False if there is none or the driver rejects it.
+    static bool Load(uint64_t key, GLuint program);
+    // Stores program's binary, which must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    static bool Write(uint64_t key, GLuint program);
+private:
+    ProgramCache() {}
+};
\ No newline at end of file
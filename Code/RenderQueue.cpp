@@ -0,0 +1,224 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cstddef>
+
+void MaterialShader::Set(const Shader& shader) {
+    Program = shader;
+    Uniforms.Resolve(shader);
+}
+
+void RenderQueue::Begin(const glm::mat4& projection, const glm::mat4& view, glm::vec3 viewPos, float farPlane) {
+    packets.clear();
+    transforms.clear();
+    projView = projection * view;
+    this->viewPos = viewPos;
+    this->farPlane = farPlane;
+    projectionScale = projection[1][1];
+    FrameStats = Stats{};
+}
+
+GLuint RenderQueue::AddTransform(const glm::mat4& model, const glm::mat3& normalMatrix) {
+    InstanceData transform;
+    transform.Model = model;
+    transform.NormalMatrix = normalMatrix;
+    transforms.push_back(transform);
+    return (GLuint)transforms.size() - 1;
+}
+
+void RenderQueue::Submit(MaterialShader& shader, MaterialShader* instanced, const Mesh& mesh, GLuint lightingSlot, GLuint transform, GLuint lod) {
+    // Front to back within a state bucket, to make the most of early depth testing
+    float distance = glm::length(glm::vec3(transforms[transform].Model[3]) - viewPos);
+    uint64_t depth = (uint64_t)(glm::clamp(distance / farPlane, 0.0f, 1.0f) * 0x3FFF);
+
+    DrawPacket packet;
+    GLuint vertexArray = mesh.VertexArray();
+    // Geometry handles are only unique within their arena
+    uint64_t geometry = ((uint64_t)vertexArray << 32) | mesh.GeometryID();
+    packet.Key = ((uint64_t)programIndices.Get(shader.Program.ID, 8) << 56)
+        | ((uint64_t)textureSetIndices.Get(mesh.MeshMaterial.TextureSet(), 14) << 42)
+        | ((uint64_t)vertexArrayIndices.Get(vertexArray, 2) << 40)
+        | ((uint64_t)geometryIndices.Get(geometry, 16) << 24)
+        | ((uint64_t)(lod & 0x3) << 22)
+        | ((uint64_t)(lightingSlot & 0xFF) << 14)
+        | depth;
+    packet.Program = &shader;
+    packet.InstancedProgram = (instanced != nullptr && instanced->Valid()) ? instanced : nullptr;
+    packet.Geometry = &mesh;
+    packet.Lod = lod;
+    packet.LightingSlot = lightingSlot;
+    packet.Transform = transform;
+    packets.push_back(packet);
+}
+
+float RenderQueue::ScreenSize(const BoundingSphere& sphere) const {
+    float distance = glm::length(sphere.Center - viewPos);
+    // Close enough to be inside the sphere, it fills the screen
+    if (distance <= sphere.Radius) return 1.0f;
+    return sphere.Radius * projectionScale / distance;
+}
+
+const RenderQueue::ProgramUniforms& RenderQueue::getProgramUniforms(const Shader& shader) {
+    auto iter = programUniforms.find(shader.ID);
+    if (iter != programUniforms.end())
+        return iter->second;
+    ProgramUniforms uniforms;
+    uniforms.ProjView = shader.GetUniform("pv");
+    uniforms.Model = shader.GetUniform("model");
+    uniforms.NormalMatrix = shader.GetUniform("normalMatrix");
+    uniforms.PositionScale = shader.GetUniform("positionScale");
+    uniforms.PositionOffset = shader.GetUniform("positionOffset");
+    return programUniforms[shader.ID] = uniforms;
+}
+
+void RenderQueue::buildBatches() {
+    batches.clear();
+    instances.clear();
+    GLuint i = 0;
+    while (i < packets.size()) {
+        const DrawPacket& first = packets[i];
+        GLuint end = i + 1;
+        if (first.InstancedProgram != nullptr) {
+            while (end < packets.size()
+                && packets[end].Geometry == first.Geometry
+                && packets[end].Lod == first.Lod
+                && packets[end].Program == first.Program
+                && packets[end].LightingSlot == first.LightingSlot)
+                end++;
+        }
+
+        Batch batch;
+        batch.First = i;
+        batch.Count = end - i;
+        batch.InstanceOffset = -1;
+        if (batch.Count >= INSTANCING_THRESHOLD) {
+            batch.InstanceOffset = (GLint)instances.size();
+            for (GLuint j = i; j < end; j++) {
+                instances.push_back(transforms[packets[j].Transform]);
+            }
+        } else {
+            // Too short to be worth it, split back into plain draws
+            batch.Count = 1;
+            end = i + 1;
+        }
+        batches.push_back(batch);
+        i = end;
+    }
+}
+
+void RenderQueue::setInstanceAttributes(GLint offset, bool enable) {
+    // mat4 model (4 slots), mat3 normal matrix (3 slots)
+    const GLuint slots = 7;
+    if (!enable) {
+        for (GLuint i = 0; i < slots; i++)
+            glDisableVertexAttribArray(INSTANCE_ATTRIB_BASE + i);
+        return;
+    }
+    const GLsizei stride = sizeof(InstanceData);
+    const size_t base = (size_t)offset * stride;
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    for (GLuint i = 0; i < slots; i++) {
+        GLuint location = INSTANCE_ATTRIB_BASE + i;
+        size_t attribOffset;
+        GLint size;
+        if (i < 4) {
+            attribOffset = offsetof(InstanceData, Model) + i * sizeof(glm::vec4);
+            size = 4;
+        } else {
+            attribOffset = offsetof(InstanceData, NormalMatrix) + (i - 4) * sizeof(glm::vec3);
+            size = 3;
+        }
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, stride, (void*)(base + attribOffset));
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+void RenderQueue::Flush(LightingBuffer& lighting) {
+    std::sort(packets.begin(), packets.end(), [](const DrawPacket& a, const DrawPacket& b) {
+        return a.Key < b.Key;
+    });
+    buildBatches();
+
+    // Every batch's instance data goes up in one go
+    if (!instances.empty()) {
+        if (instanceVBO == 0)
+            glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * instances.size(), &instances[0], GL_STREAM_DRAW);
+    }
+
+    // What the GL currently has bound, as far as this frame is concerned
+    GLuint program = 0;
+    const Material* material = nullptr;
+    GLuint vertexArray = 0;
+    GLint lightingSlot = -1;
+    GLint transform = -1;
+    const Mesh* dequantized = nullptr;
+    const ProgramUniforms* uniforms = nullptr;
+    for (auto& tex : boundTextures) tex = 0;
+
+    for (auto& batch : batches) {
+        const DrawPacket& packet = packets[batch.First];
+        bool instanced = batch.InstanceOffset >= 0;
+        MaterialShader* shader = instanced ? packet.InstancedProgram : packet.Program;
+        Shader& activeProgram = shader->Program;
+
+        if (activeProgram.ID != program) {
+            program = activeProgram.ID;
+            activeProgram.Use();
+            uniforms = &getProgramUniforms(activeProgram);
+            activeProgram.SetMatrix4(uniforms->ProjView, &projView);
+            // Material and transform uniforms belong to the program, so resend them
+            material = nullptr;
+            transform = -1;
+            dequantized = nullptr;
+            FrameStats.ProgramChanges++;
+        }
+        const Material* packetMaterial = &packet.Geometry->MeshMaterial;
+        if (packetMaterial != material) {
+            material = packetMaterial;
+            FrameStats.TextureBinds += material->Apply(activeProgram, shader->Uniforms, boundTextures);
+            FrameStats.MaterialChanges++;
+        }
+        if (packet.Geometry->VertexArray() != vertexArray) {
+            vertexArray = packet.Geometry->VertexArray();
+            glBindVertexArray(vertexArray);
+            FrameStats.VertexArrayChanges++;
+        }
+        if (packet.Geometry != dequantized) {
+            dequantized = packet.Geometry;
+            activeProgram.SetVector3f(uniforms->PositionScale, &dequantized->PositionScale);
+            activeProgram.SetVector3f(uniforms->PositionOffset, &dequantized->PositionOffset);
+        }
+        if ((GLint)packet.LightingSlot != lightingSlot) {
+            lightingSlot = packet.LightingSlot;
+            lighting.Bind(packet.LightingSlot);
+            FrameStats.LightingChanges++;
+        }
+
+        if (instanced) {
+            setInstanceAttributes(batch.InstanceOffset, true);
+            packet.Geometry->DrawElements(batch.Count, packet.Lod);
+            // Leave the mesh's VAO clean for plain draws
+            setInstanceAttributes(0, false);
+            FrameStats.InstancedDraws++;
+            FrameStats.Instances += batch.Count;
+        } else {
+            if ((GLint)packet.Transform != transform) {
+                transform = packet.Transform;
+                const InstanceData& data = transforms[packet.Transform];
+                activeProgram.SetMatrix4(uniforms->Model, &data.Model);
+                activeProgram.SetMatrix3(uniforms->NormalMatrix, &data.NormalMatrix);
+                FrameStats.TransformUploads++;
+            }
+            packet.Geometry->DrawElements(1, packet.Lod);
+        }
+        GLuint triangles = packet.Geometry->Triangles(packet.Lod) * batch.Count;
+        FrameStats.Triangles += triangles;
+        FrameStats.LodTriangles[packet.Lod] += triangles;
+        FrameStats.DrawCalls++;
+    }
+    FrameStats.Packets = (GLuint)packets.size();
+    glBindVertexArray(0);
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "LightingBuffer.h"
+
+using std::vector;
+
+// Runs of at least this many identical draws go through the instanced path
+#define INSTANCING_THRESHOLD 2
+
+// First vertex attribute location used by the per-instance data
+#define INSTANCE_ATTRIB_BASE 3
+
+// A shader along with the material uniform handles resolved for it
+struct MaterialShader {
+    Shader Program;
+    MaterialUniforms Uniforms;
+
+    void Set(const Shader& shader);
+    bool Valid() const { return Program.ID != 0; }
+};
+
+// Per-instance attributes, laid out as read by material.vert with INSTANCED defined
+struct InstanceData {
+    glm::mat4 Model;
+    glm::mat3 NormalMatrix;
+};
+
+// Hands out dense indices 0..N-1 for sparse IDs, so they fit in a few sort key bits
+template <typename T>
+class DenseIndex {
+public:
+    GLuint Get(T id, GLuint bits) {
+        auto iter = indices.find(id);
+        if (iter != indices.end())
+            return iter->second;
+        GLuint index = (GLuint)indices.size();
+        assert(index < (1u << bits) && "RenderQueue - Too many distinct values for a sort key field.");
+        indices.emplace(id, index);
+        return index;
+    }
+private:
+    std::unordered_map<T, GLuint> indices;
+};
+
+// A single mesh draw, recorded during submission and issued after sorting
+struct DrawPacket {
+    uint64_t Key;
+    MaterialShader* Program;
+    // Optional instanced variant of Program, used when the draw can be batched
+    MaterialShader* InstancedProgram;
+    const Mesh* Geometry;
+    GLuint Lod;
+    GLuint LightingSlot;
+    GLuint Transform;
+};
+
+// Collects the frame's draws, sorts them by state and issues them in one go,
+// skipping every program, material, texture, VAO and lighting change that
+// would not actually change anything. Consecutive draws of the same mesh
+// with the same light set are merged into one instanced draw.
+//
+// Sort key layout, most significant first:
+//  program (8) | texture set (14) | vertex array (2) | geometry (16) | lod (2) | lighting slot (8) | depth (14)
+// Programs, texture sets, vertex arrays and geometry are keyed by dense indices rather than
+// their GL names, so distinct values never share a key. Meshes share their arena's vertex
+// array, geometry and lod keep each mesh's draws together.
+class RenderQueue
+{
+public:
+    struct Stats {
+        GLuint Packets;
+        GLuint DrawCalls;
+        GLuint InstancedDraws;
+        GLuint Instances; // Packets drawn through the instanced path
+        GLuint ProgramChanges;
+        GLuint MaterialChanges;
+        GLuint TextureBinds;
+        GLuint VertexArrayChanges;
+        GLuint LightingChanges;
+        GLuint TransformUploads;
+        GLuint Triangles;
+        GLuint LodTriangles[MAX_LODS]; // Triangles drawn at each level of detail
+    };
+    Stats FrameStats = {};
+
+    // Starts a new frame. Depth in the sort key is measured from viewPos, up to farPlane.
+    void Begin(const glm::mat4& projection, const glm::mat4& view, glm::vec3 viewPos, float farPlane);
+    // Stores a model matrix and its normal matrix for this frame, returning its index for Submit
+    GLuint AddTransform(const glm::mat4& model, const glm::mat3& normalMatrix);
+    void Submit(MaterialShader& shader, MaterialShader* instanced, const Mesh& mesh, GLuint lightingSlot, GLuint transform, GLuint lod = 0);
+    // Height of a world space sphere on screen this frame, as a fraction of the viewport height
+    float ScreenSize(const BoundingSphere& sphere) const;
+    // Sorts and draws everything submitted since Begin
+    void Flush(LightingBuffer& lighting);
+private:
+    // Per-program uniforms owned by the queue rather than the models
+    struct ProgramUniforms {
+        UniformId ProjView;
+        UniformId Model;
+        UniformId NormalMatrix;
+        UniformId PositionScale;
+        UniformId PositionOffset;
+    };
+    // A run of sorted packets that is drawn with a single call
+    struct Batch {
+        GLuint First, Count;
+        // Offset of the batch's instance data, or -1 for a plain draw
+        GLint InstanceOffset;
+    };
+
+    vector<DrawPacket> packets;
+    vector<InstanceData> transforms;
+    vector<Batch> batches;
+    vector<InstanceData> instances;
+    std::unordered_map<GLuint, ProgramUniforms> programUniforms;
+    DenseIndex<GLuint> programIndices;
+    DenseIndex<uint64_t> textureSetIndices;
+    DenseIndex<GLuint> vertexArrayIndices;
+    DenseIndex<uint64_t> geometryIndices;
+
+    GLuint instanceVBO = 0;
+    glm::mat4 projView;
+    glm::vec3 viewPos;
+    float farPlane;
+    float projectionScale; // cot(fov / 2)
+    GLuint boundTextures[MATERIAL_UNITS];
+
+    const ProgramUniforms& getProgramUniforms(const Shader& shader);
+    void buildBatches();
+    void setInstanceAttributes(GLint offset, bool enable);
+};
\ No newline at end of file
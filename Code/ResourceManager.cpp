@@ -1,314 +1,903 @@
-#include "ResourceManager.h"
-
-#include <iostream>
-#include <sstream>
-#include <fstream>
-#include <stdexcept>
-
-#include <assimp/Importer.hpp>
-#include <assimp/postprocess.h>
-#include <glm/gtc/type_ptr.hpp>
-#include <glm/gtx/quaternion.hpp>
-#include <glm/gtx/string_cast.hpp>
-
-
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
-using std::string;
-
-map<string, Texture2D> ResourceManager::Textures;
-map<string, Shader> ResourceManager::Shaders;
-map<string, ModelData> ResourceManager::Models;
-
-
-Shader ResourceManager::LoadShader(const GLchar* vShaderFile, const GLchar* fShaderFile, const GLchar* gShaderFile, string name)
-{
-	Shaders[name] = loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile);
-	return Shaders[name];
-}
-
-Shader ResourceManager::GetShader(string name)
-{
-	return Shaders[name];
-}
-
-Texture2D ResourceManager::LoadTexture(const GLchar* file, string name, GLboolean alpha, Texture2D::TextureType textype)
-{
-	Textures[name] = loadTextureFromFile(file, alpha, textype);
-	return Textures[name];
-}
-
-Texture2D ResourceManager::GetTexture(string name)
-{
-	return Textures[name];
-}
-
-ModelData ResourceManager::LoadModelData(string filename, string name) {
-	Models[name] = loadModelDataFromFile(filename);
-
-    auto model = Models[name];
-    printf("Loaded new model - %s\n", name);
-    printf(" Meshes: %d, Lamps: %d ", model.meshes.size(), model.lamps.size());
-    int totaltex = 0;
-    for (auto mesh : model.meshes) {
-        totaltex += mesh.Textures.size();
-    }
-    printf("Textures: %d\n", totaltex);
-    for (auto lamp : model.lamps) {
-        printf("Lamp\n");
-        printf(" Pos %s\n Col %s\n", glm::to_string(lamp.Position), glm::to_string(lamp.Color));
-    }
-	return Models[name];
-}
-
-ModelData ResourceManager::GetModelData(string name) {
-	return Models[name];
-}
-
-glm::vec2 ResourceManager::AiToGlm(aiVector2D aiV) {
-    return glm::vec2(aiV.x, aiV.y);
-}
-
-glm::mat4 ResourceManager::AiToGlm(aiMatrix4x4 aiM) {
-    float values[16] = {
-        aiM.a1, aiM.a2, aiM.a3, aiM.a4,
-        aiM.b1, aiM.b2, aiM.b3, aiM.b4,
-        aiM.c1, aiM.c2, aiM.c3, aiM.c4,
-        aiM.d1, aiM.d2, aiM.d3, aiM.d4
-    };
-    return glm::make_mat4(values);
-}
-
-glm::vec3 ResourceManager::AiToGlm(aiVector3D aiV) {
-    return glm::vec3(aiV.x, aiV.y, aiV.z);
-}
-
-glm::vec4 ResourceManager::AiToGlm(aiColor3D aiC) {
-    return glm::vec4(aiC.r, aiC.g, aiC.b, 1);
-}
-glm::vec4 ResourceManager::AiToGlm(aiColor4D aiC) {
-    return glm::vec4(aiC.r, aiC.g, aiC.b, aiC.a);
-}
-
-Texture2D::TextureType ResourceManager::AiToTex2D(aiTextureType aiT) {
-    switch (aiT) {
-        case aiTextureType_DIFFUSE:
-            return Texture2D::TextureType::DIFFUSE;
-        case aiTextureType_SPECULAR:
-            return Texture2D::TextureType::SPECULAR;
-        default:
-            throw std::invalid_argument("ResourceManager::AiToTex2D - Texture type is not supported.");
-    }
-}
-
-void ResourceManager::loadObjectsFromNode(const aiNode* node, const aiScene* scene, glm::mat4 currentTransform, vector<AssimpMesh>* assimpmeshes) {
-    double factor;
-    if (node->mMetaData != NULL) {
-        node->mMetaData->Get("UnitScaleFactor", factor);
-        printf("[META]: SF - %f\n", factor);
-    }
-    
-
-    // Add this node's transform to the stack
-    currentTransform = currentTransform * AiToGlm(node->mTransformation);
-    // Iterate through each mesh in this node
-    for (unsigned int meshIndex=0; meshIndex<node->mNumMeshes; meshIndex++) {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[meshIndex]];
-        // Construct the Mesh struct
-        AssimpMesh meshStruct;
-        meshStruct.Transform = currentTransform;
-        // Add each vertex to the struct
-        for (unsigned int vertIndex=0; vertIndex<mesh->mNumVertices; vertIndex++) {
-            MeshVertex vertex;
-            vertex.Position = AiToGlm(mesh->mVertices[vertIndex]);
-            
-            if (mesh->mNormals != NULL)
-                vertex.Normal = AiToGlm(mesh->mNormals[vertIndex]);
-
-            if (mesh->mTextureCoords[0] != NULL) {
-                vertex.TexCoords = (glm::vec2)AiToGlm(mesh->mTextureCoords[0][vertIndex]);
-            } else {
-                vertex.TexCoords = glm::vec2(0);
-            }
-            meshStruct.Vertices.push_back(vertex);
-        }
-        // Add each index inside each face to the struct
-        for (unsigned int faceIndex=0; faceIndex<mesh->mNumFaces; faceIndex++) {
-            aiFace face = mesh->mFaces[faceIndex];
-            // aiProcess_Triangulate should make sure that all faces are triangles
-
-            if (face.mNumIndices != 3) {
-                printf("Skipping index %d as it has %d faces.\n", faceIndex, face.mNumIndices);
-            } else {
-                for (unsigned int i=0; i<face.mNumIndices; i++) {
-                    meshStruct.Indices.push_back(face.mIndices[i]);
-                }
-            }
-            
-        }
-        if (mesh->mMaterialIndex >= 0)
-        {
-            aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-            aiColor3D color;
-            material->Get(AI_MATKEY_COLOR_DIFFUSE, color);
-            meshStruct.DiffuseColor = AiToGlm(color);
-            material->Get(AI_MATKEY_COLOR_SPECULAR, color);
-            meshStruct.SpecularColor = AiToGlm(color);
-            material->Get(AI_MATKEY_COLOR_AMBIENT, color);
-            meshStruct.AmbientColor = AiToGlm(color);
-            material->Get(AI_MATKEY_COLOR_EMISSIVE, color);
-            meshStruct.EmissiveColor = AiToGlm(color);
-            material->Get(AI_MATKEY_COLOR_TRANSPARENT, color);
-            meshStruct.TransparentColor = AiToGlm(color);
-            
-            meshStruct.Textures = loadMaterialTextures(material, aiTextureType_DIFFUSE);
-        }
-
-        assimpmeshes->push_back(meshStruct);
-    }
-
-    // Recursively run this function for all of this node's children
-    for (unsigned int childIndex=0; childIndex<node->mNumChildren; childIndex++) {
-        aiNode* child = node->mChildren[childIndex];
-        loadObjectsFromNode(child, scene, currentTransform, assimpmeshes);
-    }
-}
-
-vector<Texture2D> ResourceManager::loadMaterialTextures(aiMaterial *mat, aiTextureType type) {
-    vector<Texture2D> textures;
-    for (unsigned int i=0; i<mat->GetTextureCount(type); i++) {
-        aiString str;
-        mat->GetTexture(type, i, &str);
-        
-        string fullpath = "Textures\\";
-        fullpath.append(str.C_Str());
-        Texture2D texture = loadTextureFromFile(fullpath.c_str(), false, AiToTex2D(type));
-        textures.push_back(texture);
-    }
-    return textures;
-}
-
-ModelData ResourceManager::loadModelDataFromFile(string filename) {
-    Assimp::Importer importer;
-    ModelData outmodel;
-    const aiScene* scene = importer.ReadFile(filename,
-        // aiProcess_CalcTangentSpace |
-        aiProcess_Triangulate |
-        aiProcess_JoinIdenticalVertices |
-        aiProcess_SortByPType
-    );
-
-    if (!scene) {
-        fprintf(stderr, "ASSIMP ERROR - %s\n", importer.GetErrorString());
-        return outmodel;
-    }
-
-    vector<AssimpMesh> assimpMeshes;
-    loadObjectsFromNode(scene->mRootNode, scene, glm::mat4(1.0), &assimpMeshes);
-
-    for (auto mesh : assimpMeshes) {
-        vector<MeshVertex> verts;
-        vector<GLuint> inds;
-        vector<Texture2D> texs;
-        Mesh outmesh = Mesh();
-
-        for (auto vert : mesh.Vertices) {
-            glm::vec4 vert4 = glm::vec4(vert.Position, 1);
-            vert.Position = (glm::vec3)(vert4 * mesh.Transform);
-            verts.push_back(vert);
-        }   
-        for (auto ind : mesh.Indices) {
-            inds.push_back(ind);
-        }
-        for (auto tex : mesh.Textures) {
-            texs.push_back(tex);
-        }
-
-        // Copy data from struct to Mesh object
-        outmesh.Import(verts, inds, texs);
-        outmesh.DiffuseColor = mesh.DiffuseColor;
-
-        outmodel.meshes.push_back(outmesh);
-    }
-
-    for (unsigned int lampIndex = 0; lampIndex < scene->mNumLights; lampIndex++) {
-        ModelLamp lampStruct;
-        aiLight* lamp = scene->mLights[lampIndex];
-        lampStruct.Color = AiToGlm(lamp->mColorDiffuse);
-        lampStruct.Position = AiToGlm(lamp->mPosition);
-        outmodel.lamps.push_back(lampStruct);
-    }
-
-    return outmodel;
-}
-
-void ResourceManager::Clear()
-{
-	for (auto iter : Shaders)
-		glDeleteProgram(iter.second.ID);
-	for (auto iter : Textures)
-		glDeleteTextures(1, &iter.second.ID);
-	Shaders.clear();
-	Textures.clear();
-	Models.clear();
-}
-
-Shader ResourceManager::loadShaderFromFile(const GLchar* vShaderFile, const GLchar* fShaderFile, const GLchar* gShaderFile)
-{
-	string vertexCode;
-	string fragmentCode;
-	string geometryCode;
-	try
-	{
-		std::ifstream vertexShaderFile(vShaderFile);
-		std::ifstream fragmentShaderFile(fShaderFile);
-		std::stringstream vShaderStream, fShaderStream;
-		vShaderStream << vertexShaderFile.rdbuf();
-		fShaderStream << fragmentShaderFile.rdbuf();
-		vertexShaderFile.close();
-		fragmentShaderFile.close();
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-		if (gShaderFile != nullptr) {
-			std::ifstream geometryShaderFile(gShaderFile);
-			std::stringstream gShaderStream;
-			gShaderStream << geometryShaderFile.rdbuf();
-			geometryShaderFile.close();
-			geometryCode = gShaderStream.str();
-		}
-	}
-	catch (std::exception e)
-	{
-		std::cout << "ERROR::SHADER: Failed to read shader files" << std::endl;
-	}
-	const GLchar* vShaderCode = vertexCode.c_str();
-	const GLchar* fShaderCode = fragmentCode.c_str();
-	const GLchar* gShaderCode = geometryCode.c_str();
-	Shader shader;
-	shader.Compile(vShaderCode, fShaderCode, gShaderFile != nullptr ? gShaderCode : nullptr);
-	return shader;
-}
-
-Texture2D ResourceManager::loadTextureFromFile(const GLchar* file, GLboolean alpha, Texture2D::TextureType textype)
-{
-	Texture2D texture;
-	if (alpha) {
-		texture.Internal_Format = GL_RGBA;
-		texture.Image_Format = GL_RGBA;
-	} else {
-        texture.Internal_Format = GL_RGB;
-        texture.Image_Format = GL_RGB;
-    }
-	int width, height;
-	//unsigned char* image = SOIL_load_image(file, &width, &height, 0, texture.Image_Format == GL_RGBA ? SOIL_LOAD_RGBA : SOIL_LOAD_RGB);
-	
-    int comp = (texture.Image_Format == GL_RGBA ? STBI_rgb_alpha : STBI_rgb);
-
-	unsigned char* image = stbi_load(file, &width, &height, &comp, 0);
-
-	texture.Generate(width, height, image, textype);
-	//SOIL_free_image_data(image);
-	stbi_image_free(image);
-	return texture;
-}
+#include "ResourceManager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define IMPORT_SSE
+#include <xmmintrin.h>
+#endif
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <glm/gtx/string_cast.hpp>
+
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Profiler.h"
+#include "ProgramCache.h"
+#include "TextureCooker.h"
+#include "Util.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+using std::string;
+
+// Part of the cooked mesh key, changing these invalidates every cooked file
+const unsigned int IMPORT_FLAGS =
+    // aiProcess_CalcTangentSpace |
+    aiProcess_Triangulate |
+    aiProcess_JoinIdenticalVertices |
+    aiProcess_SortByPType;
+
+// Model data releases its textures into the cache when destroyed, so the cache
+// is defined first to be destroyed last. Clear should still have emptied
+// everything before main returns, static teardown is only a backstop.
+map<GLuint, CachedTexture> ResourceManager::textureCache;
+map<string, GLuint> ResourceManager::texturePaths;
+map<uint64_t, GLuint> ResourceManager::textureContents;
+std::mutex ResourceManager::textureMutex;
+map<string, Texture2D> ResourceManager::Textures;
+map<string, Shader> ResourceManager::Shaders;
+map<string, ShaderSource> ResourceManager::shaderSources;
+map<string, ModelHandle> ResourceManager::Models;
+vector<std::shared_ptr<PendingModel>> ResourceManager::readyModels;
+std::mutex ResourceManager::readyMutex;
+std::deque<std::shared_ptr<PendingModel>> ResourceManager::uploadQueue;
+int ResourceManager::pendingLoads = 0;
+VertexFormat ResourceManager::MeshFormat = VertexFormat::Packed;
+ResourceManager::TextureCacheStats ResourceManager::TextureStats;
+TextureStreamer ResourceManager::Streamer;
+
+// Notes every file an import opens besides the model itself, so the cooked
+// copy can be checked against them as well as the source
+class RecordingIOSystem : public Assimp::DefaultIOSystem {
+public:
+    RecordingIOSystem(const string& source, vector<string>& opened) : source(source), opened(opened) {}
+
+    using Assimp::DefaultIOSystem::Open;
+    Assimp::IOStream* Open(const char* file, const char* mode) override {
+        // Failed opens count too, adding a missing material library should reimport
+        string path(file);
+        if (path != source && std::find(opened.begin(), opened.end(), path) == opened.end())
+            opened.push_back(path);
+        return Assimp::DefaultIOSystem::Open(file, mode);
+    }
+private:
+    string source;
+    vector<string>& opened;
+};
+
+ImageData::~ImageData() {
+    if (Pixels != nullptr)
+        stbi_image_free(Pixels);
+}
+
+size_t ImageData::Bytes() const {
+    if (!Levels.empty()) {
+        size_t bytes = 0;
+        for (auto& level : Levels) {
+            bytes += level.Size;
+        }
+        return bytes;
+    }
+    return (size_t)Width * Height * (Alpha ? 4 : 3);
+}
+
+ModelData::~ModelData() {
+    for (auto& mesh : meshes) {
+        for (auto& tex : mesh.Textures) {
+            ResourceManager::ReleaseTexture(tex);
+        }
+        mesh.Release();
+    }
+}
+
+
+Shader ResourceManager::LoadShader(const GLchar* vShaderFile, const GLchar* fShaderFile, const GLchar* gShaderFile, string name, GLuint features)
+{
+	ShaderSource& source = shaderSources[name];
+	source = loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile);
+	source.Features = features;
+	Shaders[name] = GetShaderVariant(name, 0);
+	return Shaders[name];
+}
+
+Shader ResourceManager::GetShaderVariant(const string& name, GLuint features)
+{
+	auto found = shaderSources.find(name);
+	if (found == shaderSources.end())
+		return Shaders[name];
+	ShaderSource& source = found->second;
+	features &= source.Features;
+	auto variant = source.Variants.find(features);
+	if (variant != source.Variants.end())
+		return variant->second;
+
+	auto start = std::chrono::steady_clock::now();
+	GLuint cached = ProgramCache::LoadStats.Loaded;
+	auto building = source.Building.find(features);
+	if (building == source.Building.end()) {
+		startShaderVariant(source, features);
+		building = source.Building.find(features);
+	}
+	Shader shader = building->second;
+	shader.FinishCompile();
+	source.Building.erase(building);
+	source.Variants[features] = shader;
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+	printf("Loaded shader %s (features 0x%x) - %.2f ms, %s\n", name.c_str(), features, elapsed.count() / 1000.0,
+		ProgramCache::LoadStats.Loaded != cached ? "cached binary" : "compiled");
+	return shader;
+}
+
+bool ResourceManager::RequestShaderVariant(const string& name, GLuint features, Shader& shader)
+{
+	auto found = shaderSources.find(name);
+	if (found == shaderSources.end()) {
+		shader = Shaders[name];
+		return true;
+	}
+	ShaderSource& source = found->second;
+	features &= source.Features;
+	auto variant = source.Variants.find(features);
+	if (variant != source.Variants.end()) {
+		shader = variant->second;
+		return true;
+	}
+	if (source.Building.find(features) == source.Building.end())
+		startShaderVariant(source, features);
+	return false;
+}
+
+void ResourceManager::PrepareShaderVariants(const string& name)
+{
+	auto found = shaderSources.find(name);
+	if (found == shaderSources.end())
+		return;
+	ShaderSource& source = found->second;
+	// Every subset of the feature bits
+	GLuint features = 0;
+	do {
+		if (source.Variants.find(features) == source.Variants.end() && source.Building.find(features) == source.Building.end())
+			startShaderVariant(source, features);
+		features = (features - source.Features) & source.Features;
+	} while (features != 0);
+}
+
+void ResourceManager::ProcessShaderBuilds()
+{
+	PROFILE_ZONE("Shader builds");
+	for (auto& source : shaderSources) {
+		auto& building = source.second.Building;
+		for (auto iter = building.begin(); iter != building.end();) {
+			if (!iter->second.CompileReady()) {
+				++iter;
+				continue;
+			}
+			auto start = std::chrono::steady_clock::now();
+			Shader shader = iter->second;
+			shader.FinishCompile();
+			source.second.Variants[iter->first] = shader;
+			auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+			printf("Loaded shader %s (features 0x%x) - built in the background, %.2f ms to finish\n", source.first.c_str(), iter->first, elapsed.count() / 1000.0);
+			iter = building.erase(iter);
+		}
+	}
+}
+
+void ResourceManager::startShaderVariant(ShaderSource& source, GLuint features)
+{
+	// Ones that come from the binary cache are ready by the next ProcessShaderBuilds
+	Shader shader;
+	shader.BeginCompile(source.Vertex.c_str(), source.Fragment.c_str(), source.HasGeometry ? source.Geometry.c_str() : nullptr, features);
+	source.Building[features] = shader;
+}
+
+GLuint ResourceManager::ShaderFeatures(const string& name)
+{
+	auto found = shaderSources.find(name);
+	return found != shaderSources.end() ? found->second.Features : 0;
+}
+
+Shader ResourceManager::GetShader(string name)
+{
+	return Shaders[name];
+}
+
+Texture2D ResourceManager::LoadTexture(const GLchar* file, string name, GLboolean alpha, Texture2D::TextureType textype)
+{
+	Textures[name] = loadTextureFromFile(file, alpha, textype);
+	return Textures[name];
+}
+
+Texture2D ResourceManager::GetTexture(string name)
+{
+	return Textures[name];
+}
+
+ModelHandle ResourceManager::LoadModelData(string filename, string name) {
+	ModelHandle model = std::make_shared<ModelData>(loadModelDataFromFile(filename));
+	Models[name] = model;
+
+    printf("Loaded new model - %s\n", name.c_str());
+    printf(" Meshes: %d, Lamps: %d ", (int)model->meshes.size(), (int)model->lamps.size());
+    int totaltex = 0;
+    for (auto& mesh : model->meshes) {
+        totaltex += mesh.Textures.size();
+    }
+    printf("Textures: %d\n", totaltex);
+    for (auto& lamp : model->lamps) {
+        printf("Lamp\n");
+        printf(" Pos %s\n Col %s\n", glm::to_string(lamp.Position).c_str(), glm::to_string(lamp.Color).c_str());
+    }
+	return model;
+}
+
+ThreadPool& ResourceManager::workers() {
+    // Created on first use so that programs without async loads never spawn threads
+    static ThreadPool pool;
+    return pool;
+}
+
+ModelFuture ResourceManager::LoadModelDataAsync(string filename, string name) {
+    auto pending = std::make_shared<PendingModel>();
+    pending->Name = name;
+    pending->Filename = filename;
+    pending->Requested = std::chrono::steady_clock::now();
+    // Held by the parse job, which also takes one for each texture decode it starts
+    pending->Outstanding = 1;
+    ModelFuture future = pending->Promise.get_future().share();
+    pendingLoads++;
+
+    workers().Enqueue([pending]() {
+        if (parseModelFile(*pending)) {
+            // One decode per distinct image, skipping any the texture cache already has
+            map<string, vector<TextureRef*>> decodes;
+            for (auto& mesh : pending->Meshes) {
+                for (auto& tex : mesh.Textures) {
+                    if (!textureCached(tex.Path))
+                        decodes[tex.Path].push_back(&tex);
+                }
+            }
+            for (auto& decode : decodes) {
+                pending->Outstanding++;
+                vector<TextureRef*> refs = decode.second;
+                workers().Enqueue([pending, refs]() {
+                    auto image = decodeImage(refs[0]->Path.c_str(), GL_FALSE);
+                    for (auto ref : refs) {
+                        ref->Image = image;
+                    }
+                    finishWorkerJob(pending);
+                });
+            }
+        }
+        finishWorkerJob(pending);
+    });
+    return future;
+}
+
+void ResourceManager::finishWorkerJob(const std::shared_ptr<PendingModel>& pending) {
+    if (--pending->Outstanding > 0) return;
+    std::lock_guard<std::mutex> lock(readyMutex);
+    readyModels.push_back(pending);
+}
+
+void ResourceManager::ProcessUploads(size_t byteBudget) {
+    PROFILE_ZONE("Model uploads");
+    {
+        std::lock_guard<std::mutex> lock(readyMutex);
+        for (auto& pending : readyModels) {
+            uploadQueue.push_back(pending);
+        }
+        readyModels.clear();
+    }
+
+    size_t uploaded = 0;
+    bool first = true;
+    while (!uploadQueue.empty() && (first || uploaded < byteBudget)) {
+        auto& pending = uploadQueue.front();
+        if (pending->NextMesh < pending->Meshes.size()) {
+            uploaded += uploadMesh(*pending);
+            first = false;
+        } else {
+            publishModel(*pending);
+            uploadQueue.pop_front();
+            pendingLoads--;
+        }
+    }
+}
+
+bool ResourceManager::LoadsPending() {
+    return pendingLoads > 0;
+}
+
+void ResourceManager::publishModel(PendingModel& pending) {
+    for (auto& lamp : pending.Lamps) {
+        pending.Result.lamps.push_back(lamp);
+    }
+    calculateModelBounds(pending.Result);
+    ModelHandle model = std::make_shared<ModelData>(std::move(pending.Result));
+    Models[pending.Name] = model;
+    pending.Promise.set_value(model);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - pending.Requested);
+    printf("Loaded new model - %s (async, %lld ms)\n", pending.Name.c_str(), (long long)elapsed.count());
+    printf(" Meshes: %d, Lamps: %d\n", (int)model->meshes.size(), (int)model->lamps.size());
+}
+
+ModelHandle ResourceManager::GetModelData(string name) {
+    auto iter = Models.find(name);
+    if (iter == Models.end())
+        return ModelHandle();
+	return iter->second;
+}
+
+glm::vec2 ResourceManager::AiToGlm(aiVector2D aiV) {
+    return glm::vec2(aiV.x, aiV.y);
+}
+
+glm::mat4 ResourceManager::AiToGlm(aiMatrix4x4 aiM) {
+    float values[16] = {
+        aiM.a1, aiM.a2, aiM.a3, aiM.a4,
+        aiM.b1, aiM.b2, aiM.b3, aiM.b4,
+        aiM.c1, aiM.c2, aiM.c3, aiM.c4,
+        aiM.d1, aiM.d2, aiM.d3, aiM.d4
+    };
+    return glm::make_mat4(values);
+}
+
+glm::vec3 ResourceManager::AiToGlm(aiVector3D aiV) {
+    return glm::vec3(aiV.x, aiV.y, aiV.z);
+}
+
+glm::vec4 ResourceManager::AiToGlm(aiColor3D aiC) {
+    return glm::vec4(aiC.r, aiC.g, aiC.b, 1);
+}
+glm::vec4 ResourceManager::AiToGlm(aiColor4D aiC) {
+    return glm::vec4(aiC.r, aiC.g, aiC.b, aiC.a);
+}
+
+Texture2D::TextureType ResourceManager::AiToTex2D(aiTextureType aiT) {
+    switch (aiT) {
+        case aiTextureType_DIFFUSE:
+            return Texture2D::TextureType::DIFFUSE;
+        case aiTextureType_SPECULAR:
+            return Texture2D::TextureType::SPECULAR;
+        default:
+            throw std::invalid_argument("ResourceManager::AiToTex2D - Texture type is not supported.");
+    }
+}
+
+// Multiplies every vector by a matrix given as columns, writing the results
+// stride bytes apart. Points pick up the fourth column as a translation.
+static void transformVectors(const aiVector3D* in, size_t count, const glm::mat4& columns, bool points, glm::vec3* out, size_t stride) {
+    unsigned char* dest = (unsigned char*)out;
+#ifdef IMPORT_SSE
+    __m128 c0 = _mm_loadu_ps(&columns[0][0]);
+    __m128 c1 = _mm_loadu_ps(&columns[1][0]);
+    __m128 c2 = _mm_loadu_ps(&columns[2][0]);
+    __m128 c3 = points ? _mm_loadu_ps(&columns[3][0]) : _mm_setzero_ps();
+    alignas(16) float result[4];
+    for (size_t i=0; i<count; i++, dest += stride) {
+        __m128 v = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(in[i].x), c0), _mm_mul_ps(_mm_set1_ps(in[i].y), c1)),
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(in[i].z), c2), c3));
+        _mm_store_ps(result, v);
+        memcpy(dest, result, sizeof(glm::vec3));
+    }
+#else
+    glm::vec4 translation = points ? columns[3] : glm::vec4(0);
+    for (size_t i=0; i<count; i++, dest += stride) {
+        glm::vec3 v = glm::vec3(columns[0] * in[i].x + columns[1] * in[i].y + columns[2] * in[i].z + translation);
+        memcpy(dest, &v, sizeof(glm::vec3));
+    }
+#endif
+}
+
+void ResourceManager::convertMesh(const string& filename, size_t index, AssimpMesh& mesh) {
+    const aiMesh* source = mesh.Source;
+    unsigned int count = source->mNumVertices;
+    mesh.Source = nullptr;
+    // Left with empty streams, importModelFile drops it
+    if (count == 0)
+        return;
+
+    // Sized once and filled in place
+    mesh.Vertices.resize(count);
+    MeshVertex* vertices = mesh.Vertices.data();
+    // Positions are row vectors times the node transform
+    transformVectors(source->mVertices, count, glm::transpose(mesh.Transform), true, &vertices->Position, sizeof(MeshVertex));
+    if (source->mNormals != NULL) {
+        glm::mat3 normalMatrix = glm::inverse(glm::mat3(mesh.Transform));
+        transformVectors(source->mNormals, count, glm::mat4(normalMatrix), false, &vertices->Normal, sizeof(MeshVertex));
+        if (mesh.Transform != glm::mat4(1.0)) {
+            for (auto& vertex : mesh.Vertices) {
+                float length = glm::length(vertex.Normal);
+                if (length > 0) vertex.Normal = vertex.Normal / length;
+            }
+        }
+    }
+    if (source->mTextureCoords[0] != NULL) {
+        const aiVector3D* texCoords = source->mTextureCoords[0];
+        for (unsigned int i=0; i<count; i++) {
+            vertices[i].TexCoords = glm::vec2(texCoords[i].x, texCoords[i].y);
+        }
+    }
+
+    mesh.Indices.resize((size_t)source->mNumFaces * 3);
+    GLuint* indices = mesh.Indices.data();
+    size_t indexCount = 0;
+    for (unsigned int faceIndex=0; faceIndex<source->mNumFaces; faceIndex++) {
+        const aiFace& face = source->mFaces[faceIndex];
+        // aiProcess_Triangulate should make sure that all faces are triangles
+        if (face.mNumIndices != 3) {
+            printf("Skipping index %d as it has %d faces.\n", faceIndex, face.mNumIndices);
+            continue;
+        }
+        memcpy(indices + indexCount, face.mIndices, sizeof(GLuint) * 3);
+        indexCount += 3;
+    }
+    mesh.Indices.resize(indexCount);
+    if (indexCount == 0) {
+        mesh.Vertices = vector<MeshVertex>();
+        return;
+    }
+
+    // Logged in one go so lines from meshes converting side by side don't interleave
+    char line[256];
+    string log;
+    auto reorder = MeshOptimizer::Optimize(mesh.Vertices, mesh.Indices);
+    snprintf(line, sizeof(line), "Optimized %s mesh %zu - ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", filename.c_str(), index,
+        reorder.ACMRBefore, reorder.ACMRAfter, reorder.ATVRBefore, reorder.ATVRAfter);
+    log += line;
+    MeshSimplifier::BuildLods(mesh.Vertices, mesh.Indices, mesh.Lods);
+    snprintf(line, sizeof(line), "LODs for %s mesh %zu - triangles:", filename.c_str(), index);
+    log += line;
+    for (auto& lod : mesh.Lods) {
+        snprintf(line, sizeof(line), " %u (error %.4f)", lod.IndexCount / 3, lod.Error);
+        log += line;
+    }
+    printf("%s\n", log.c_str());
+
+    CalculateBounds(&mesh.Vertices.data()->Position, mesh.Vertices.size(), sizeof(MeshVertex), mesh.Box, mesh.Sphere);
+    MeshStreams& streams = mesh.Streams;
+    streams.Vertices = mesh.Vertices.data();
+    streams.VertexCount = (GLuint)mesh.Vertices.size();
+    streams.Indices = mesh.Indices.data();
+    streams.IndexCount = (GLuint)mesh.Indices.size();
+    streams.Lods = mesh.Lods.data();
+    streams.LodCount = (GLuint)mesh.Lods.size();
+    if (MeshFormat == VertexFormat::Packed) {
+        Mesh::PackVertices(mesh.Vertices.data(), streams.VertexCount, mesh.Box, mesh.PackedVertices, streams);
+        // The packed copies are all that get uploaded or cooked
+        mesh.Vertices = vector<MeshVertex>();
+        if (Mesh::ShortIndices(mesh.Indices.data(), streams.IndexCount, streams.VertexCount, mesh.ShortIndices)) {
+            streams.Indices = mesh.ShortIndices.data();
+            streams.IndexType = GL_UNSIGNED_SHORT;
+            mesh.Indices = vector<GLuint>();
+        }
+    }
+}
+
+void ResourceManager::loadObjectsFromNode(const aiNode* node, const aiScene* scene, glm::mat4 currentTransform, vector<AssimpMesh>* assimpmeshes) {
+    double factor;
+    if (node->mMetaData != NULL) {
+        node->mMetaData->Get("UnitScaleFactor", factor);
+        printf("[META]: SF - %f\n", factor);
+    }
+    
+
+    // Add this node's transform to the stack
+    currentTransform = currentTransform * AiToGlm(node->mTransformation);
+    // Iterate through each mesh in this node
+    for (unsigned int meshIndex=0; meshIndex<node->mNumMeshes; meshIndex++) {
+        aiMesh* mesh = scene->mMeshes[node->mMeshes[meshIndex]];
+        // Construct the Mesh struct in place, the vertices and indices are filled in by convertMesh
+        assimpmeshes->emplace_back();
+        AssimpMesh& meshStruct = assimpmeshes->back();
+        meshStruct.Source = mesh;
+        meshStruct.Transform = currentTransform;
+        if (mesh->mMaterialIndex >= 0)
+        {
+            aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+            aiColor3D color;
+            material->Get(AI_MATKEY_COLOR_DIFFUSE, color);
+            meshStruct.DiffuseColor = AiToGlm(color);
+            material->Get(AI_MATKEY_COLOR_SPECULAR, color);
+            meshStruct.SpecularColor = AiToGlm(color);
+            material->Get(AI_MATKEY_COLOR_AMBIENT, color);
+            meshStruct.AmbientColor = AiToGlm(color);
+            material->Get(AI_MATKEY_COLOR_EMISSIVE, color);
+            meshStruct.EmissiveColor = AiToGlm(color);
+            material->Get(AI_MATKEY_COLOR_TRANSPARENT, color);
+            meshStruct.TransparentColor = AiToGlm(color);
+            
+            meshStruct.Textures = loadMaterialTextures(material, aiTextureType_DIFFUSE);
+        }
+    }
+
+    // Recursively run this function for all of this node's children
+    for (unsigned int childIndex=0; childIndex<node->mNumChildren; childIndex++) {
+        aiNode* child = node->mChildren[childIndex];
+        loadObjectsFromNode(child, scene, currentTransform, assimpmeshes);
+    }
+}
+
+vector<TextureRef> ResourceManager::loadMaterialTextures(aiMaterial *mat, aiTextureType type) {
+    vector<TextureRef> textures;
+    for (unsigned int i=0; i<mat->GetTextureCount(type); i++) {
+        aiString str;
+        mat->GetTexture(type, i, &str);
+        
+        TextureRef texture;
+        texture.Path = "Textures\\";
+        texture.Path.append(str.C_Str());
+        texture.Type = AiToTex2D(type);
+        textures.push_back(texture);
+    }
+    return textures;
+}
+
+bool ResourceManager::parseModelFile(PendingModel& pending) {
+    PROFILE_ZONE("Parse model");
+    uint64_t sourceHash = MeshCache::SourceHash(pending.Filename);
+    if (MeshCache::Load(pending.Filename, sourceHash, IMPORT_FLAGS, MeshFormat, pending))
+        return true;
+    if (!importModelFile(pending))
+        return false;
+    MeshCache::Write(pending.Filename, sourceHash, IMPORT_FLAGS, MeshFormat, pending);
+    return true;
+}
+
+bool ResourceManager::importModelFile(PendingModel& pending) {
+    auto start = std::chrono::steady_clock::now();
+    Assimp::Importer importer;
+    // The importer owns and deletes the IO system
+    pending.Dependencies.clear();
+    importer.SetIOHandler(new RecordingIOSystem(pending.Filename, pending.Dependencies));
+    const aiScene* scene = importer.ReadFile(pending.Filename, IMPORT_FLAGS);
+
+    if (!scene) {
+        fprintf(stderr, "ASSIMP ERROR - %s\n", importer.GetErrorString());
+        return false;
+    }
+    auto read = std::chrono::steady_clock::now();
+
+    pending.Meshes.reserve(scene->mNumMeshes);
+    loadObjectsFromNode(scene->mRootNode, scene, glm::mat4(1.0), &pending.Meshes);
+    workers().ParallelFor(pending.Meshes.size(), [&](size_t i) {
+        convertMesh(pending.Filename, i, pending.Meshes[i]);
+    });
+    // Meshes with no vertices or no triangles have nothing to upload or draw
+    auto empty = std::remove_if(pending.Meshes.begin(), pending.Meshes.end(), [](const AssimpMesh& mesh) {
+        return mesh.Streams.VertexCount == 0 || mesh.Streams.IndexCount == 0;
+    });
+    if (empty != pending.Meshes.end()) {
+        printf("Skipping %zu empty meshes in %s\n", (size_t)(pending.Meshes.end() - empty), pending.Filename.c_str());
+        pending.Meshes.erase(empty, pending.Meshes.end());
+    }
+    auto converted = std::chrono::steady_clock::now();
+
+    size_t vertexCount = 0;
+    for (auto& mesh : pending.Meshes) {
+        vertexCount += mesh.Streams.VertexCount;
+    }
+    double readMs = std::chrono::duration<double, std::milli>(read - start).count();
+    double convertMs = std::chrono::duration<double, std::milli>(converted - read).count();
+    printf("Imported %s - %zu vertices, read in %.1f ms, converted in %.1f ms (%.2f M vertices/s)\n", pending.Filename.c_str(),
+        vertexCount, readMs, convertMs, vertexCount / ((readMs + convertMs) * 1000.0 + 1e-9));
+
+    for (unsigned int lampIndex = 0; lampIndex < scene->mNumLights; lampIndex++) {
+        ModelLamp lampStruct;
+        aiLight* lamp = scene->mLights[lampIndex];
+        lampStruct.Color = AiToGlm(lamp->mColorDiffuse);
+        lampStruct.Position = AiToGlm(lamp->mPosition);
+        pending.Lamps.push_back(lampStruct);
+    }
+    return true;
+}
+
+int ResourceManager::CookModels(string directory) {
+    Assimp::Importer importer;
+    int cooked = 0, current = 0, failed = 0;
+    for (auto& name : Util::list_files(directory)) {
+        size_t dot = name.find_last_of('.');
+        if (dot == string::npos || !importer.IsExtensionSupported(name.substr(dot)))
+            continue;
+
+        PendingModel pending;
+        pending.Filename = directory + "/" + name;
+        if (!parseModelFile(pending)) {
+            failed++;
+        } else if (pending.Cache) {
+            current++;
+        } else {
+            printf("Cooked %s\n", pending.Filename.c_str());
+            cooked++;
+        }
+        // Decoding cooks any texture that doesn't have an up to date copy
+        for (auto& mesh : pending.Meshes) {
+            for (auto& tex : mesh.Textures) {
+                decodeImage(tex.Path.c_str(), GL_FALSE);
+            }
+        }
+    }
+    printf("Cooked %d models, %d already up to date, %d failed\n", cooked, current, failed);
+    return failed;
+}
+
+size_t ResourceManager::uploadMesh(PendingModel& pending) {
+    AssimpMesh& mesh = pending.Meshes[pending.NextMesh++];
+    size_t bytes = mesh.Streams.VertexBytes() + mesh.Streams.IndexBytes();
+
+    vector<Texture2D> texs;
+    for (auto& tex : mesh.Textures) {
+        texs.push_back(acquireTexture(tex));
+    }
+
+    if (pending.Result.meshes.empty())
+        pending.Result.meshes.reserve(pending.Meshes.size());
+    pending.Result.meshes.emplace_back();
+    Mesh& outmesh = pending.Result.meshes.back();
+    outmesh.Import(mesh.Streams, std::move(texs), mesh.DiffuseColor);
+    outmesh.Box = mesh.Box;
+    outmesh.Sphere = mesh.Sphere;
+
+    // The GL has the only copy of the streams from here on
+    mesh.Vertices = vector<MeshVertex>();
+    mesh.Indices = vector<GLuint>();
+    mesh.PackedVertices = vector<PackedVertex>();
+    mesh.ShortIndices = vector<uint16_t>();
+    mesh.Lods = vector<MeshLod>();
+    mesh.Streams = MeshStreams();
+    if (pending.NextMesh == pending.Meshes.size())
+        pending.Cache.reset();
+    return bytes;
+}
+
+ModelData ResourceManager::loadModelDataFromFile(string filename) {
+    PendingModel pending;
+    pending.Filename = filename;
+    if (!parseModelFile(pending))
+        return ModelData();
+
+    while (pending.NextMesh < pending.Meshes.size()) {
+        uploadMesh(pending);
+    }
+    for (auto& lamp : pending.Lamps) {
+        pending.Result.lamps.push_back(lamp);
+    }
+
+    calculateModelBounds(pending.Result);
+    return std::move(pending.Result);
+}
+
+void ResourceManager::calculateModelBounds(ModelData& model) {
+    if (model.meshes.empty()) return;
+    model.Box = model.meshes[0].Box;
+    for (auto& mesh : model.meshes) {
+        model.Box.Min = glm::min(model.Box.Min, mesh.Box.Min);
+        model.Box.Max = glm::max(model.Box.Max, mesh.Box.Max);
+    }
+    // Centre on the box and grow the radius until every mesh sphere fits
+    model.Sphere.Center = model.Box.Center();
+    model.Sphere.Radius = 0;
+    for (auto& mesh : model.meshes) {
+        float reach = glm::length(mesh.Sphere.Center - model.Sphere.Center) + mesh.Sphere.Radius;
+        model.Sphere.Radius = glm::max(model.Sphere.Radius, reach);
+    }
+}
+
+void ResourceManager::Clear()
+{
+	// Every loaded shader is one of its source's variants
+	for (auto& source : shaderSources) {
+		for (auto& variant : source.second.Variants)
+			glDeleteProgram(variant.second.ID);
+		// Unfinished builds still own their stage shaders
+		for (auto& variant : source.second.Building) {
+			variant.second.FinishCompile();
+			glDeleteProgram(variant.second.ID);
+		}
+	}
+	for (auto iter : Textures)
+		glDeleteTextures(1, &iter.second.ID);
+	Shaders.clear();
+	shaderSources.clear();
+	Textures.clear();
+	Streamer.Clear();
+	// Loads still on their way in hold meshes and textures of their own
+	{
+		std::lock_guard<std::mutex> lock(readyMutex);
+		pendingLoads -= (int)readyModels.size();
+		readyModels.clear();
+	}
+	pendingLoads -= (int)uploadQueue.size();
+	uploadQueue.clear();
+	// Releases the material textures along with the models, unless something still holds a handle
+	Models.clear();
+	Mesh::Arena.Clear();
+	Mesh::PackedArena.Clear();
+}
+
+ShaderSource ResourceManager::loadShaderFromFile(const GLchar* vShaderFile, const GLchar* fShaderFile, const GLchar* gShaderFile)
+{
+	ShaderSource source;
+	try
+	{
+		std::ifstream vertexShaderFile(vShaderFile);
+		std::ifstream fragmentShaderFile(fShaderFile);
+		std::stringstream vShaderStream, fShaderStream;
+		vShaderStream << vertexShaderFile.rdbuf();
+		fShaderStream << fragmentShaderFile.rdbuf();
+		vertexShaderFile.close();
+		fragmentShaderFile.close();
+		source.Vertex = vShaderStream.str();
+		source.Fragment = fShaderStream.str();
+		if (gShaderFile != nullptr) {
+			std::ifstream geometryShaderFile(gShaderFile);
+			std::stringstream gShaderStream;
+			gShaderStream << geometryShaderFile.rdbuf();
+			geometryShaderFile.close();
+			source.Geometry = gShaderStream.str();
+			source.HasGeometry = true;
+		}
+	}
+	catch (std::exception e)
+	{
+		std::cout << "ERROR::SHADER: Failed to read shader files" << std::endl;
+	}
+	return source;
+}
+
+bool ResourceManager::textureCached(const string& path) {
+    std::lock_guard<std::mutex> lock(textureMutex);
+    return texturePaths.count(path) > 0;
+}
+
+Texture2D ResourceManager::acquireTexture(TextureRef& ref) {
+    // Not decoded yet if it was cached when the load started but has been freed since, or on the synchronous path.
+    // Only this thread changes the cache, so the answer holds once the lock is taken.
+    if (!ref.Image && !textureCached(ref.Path))
+        ref.Image = decodeImage(ref.Path.c_str(), GL_FALSE);
+
+    std::lock_guard<std::mutex> lock(textureMutex);
+    auto path = texturePaths.find(ref.Path);
+
+    GLuint id = 0;
+    if (path != texturePaths.end()) {
+        id = path->second;
+    } else {
+        auto content = ref.Image->ContentHash != 0 ? textureContents.find(ref.Image->ContentHash) : textureContents.end();
+        if (content != textureContents.end()) {
+            // Same image under another name
+            id = content->second;
+            texturePaths[ref.Path] = id;
+            textureCache.at(id).Paths.push_back(ref.Path);
+        }
+    }
+    // Any other references to this image can share it from here on
+    std::shared_ptr<ImageData> image = ref.Image;
+    ref.Image.reset();
+
+    if (id != 0) {
+        CachedTexture& cached = textureCache.at(id);
+        cached.References++;
+        TextureStats.Hits++;
+        TextureStats.BytesSaved += cached.Bytes;
+        Texture2D texture = cached.Texture;
+        // The same image can be bound as diffuse by one mesh and specular by another
+        texture.Type = ref.Type;
+        return texture;
+    }
+
+    CachedTexture cached(uploadImage(image, ref.Type));
+    cached.ContentHash = image->ContentHash;
+    cached.Paths.push_back(ref.Path);
+    cached.References = 1;
+    cached.Bytes = image->Bytes();
+    id = cached.Texture.ID;
+    textureCache.emplace(id, cached);
+    texturePaths[ref.Path] = id;
+    // Images that failed to load all hash to 0, don't let them share
+    if (cached.ContentHash != 0)
+        textureContents[cached.ContentHash] = id;
+
+    TextureStats.Misses++;
+    TextureStats.BytesResident += cached.Bytes;
+    return cached.Texture;
+}
+
+void ResourceManager::ReleaseTexture(const Texture2D& texture) {
+    std::lock_guard<std::mutex> lock(textureMutex);
+    auto iter = textureCache.find(texture.ID);
+    if (iter == textureCache.end()) return;
+    CachedTexture& cached = iter->second;
+    if (--cached.References > 0) return;
+
+    for (auto& path : cached.Paths) {
+        texturePaths.erase(path);
+    }
+    if (cached.ContentHash != 0)
+        textureContents.erase(cached.ContentHash);
+    Streamer.Cancel(cached.Texture.ID);
+    TextureStats.BytesResident -= cached.Bytes;
+    glDeleteTextures(1, &cached.Texture.ID);
+    textureCache.erase(iter);
+}
+
+Texture2D ResourceManager::loadTextureFromFile(const GLchar* file, GLboolean alpha, Texture2D::TextureType textype)
+{
+	return uploadImage(decodeImage(file, alpha), textype);
+}
+
+std::shared_ptr<ImageData> ResourceManager::decodeImage(const GLchar* file, GLboolean alpha)
+{
+	PROFILE_ZONE("Decode image");
+	auto image = std::make_shared<ImageData>();
+	image->Alpha = alpha;
+	MappedFile encoded;
+	if (!encoded.Open(file)) {
+		fprintf(stderr, "Failed to load image %s - can't open file\n", file);
+		return image;
+	}
+	image->ContentHash = Util::hash_bytes(&alpha, sizeof(alpha), Util::hash_bytes(encoded.Data(), encoded.Size()));
+	if (TextureCooker::Load(file, image->ContentHash, *image))
+		return image;
+
+	// Not cooked yet, decode to RGBA for the cooker
+	int channels;
+	unsigned char* pixels = stbi_load_from_memory(encoded.Data(), (int)encoded.Size(), &image->Width, &image->Height, &channels, STBI_rgb_alpha);
+	if (pixels == nullptr) {
+		fprintf(stderr, "Failed to load image %s - %s\n", file, stbi_failure_reason());
+		return image;
+	}
+	if (TextureCooker::Cook(file, image->ContentHash, pixels, *image))
+		stbi_image_free(pixels);
+	else
+		image->Pixels = pixels;
+	return image;
+}
+
+Texture2D ResourceManager::uploadImage(const std::shared_ptr<ImageData>& image, Texture2D::TextureType textype)
+{
+	Texture2D texture;
+	if (!image->Levels.empty()) {
+		texture.Filter_Min = GL_LINEAR_MIPMAP_LINEAR;
+		if (GLEW_EXT_texture_compression_s3tc) {
+			texture.Allocate(image->Format, image->Levels.data(), (GLuint)image->Levels.size(), textype);
+			Streamer.Enqueue(texture, image->Format, image->Levels.data(), (GLuint)image->Levels.size(), image);
+		} else {
+			auto storage = std::make_shared<vector<unsigned char>>();
+			vector<TextureLevel> levels;
+			TextureCooker::Decompress(*image, *storage, levels);
+			texture.Internal_Format = image->Alpha ? GL_RGBA : GL_RGB;
+			texture.Image_Format = GL_RGBA;
+			texture.Allocate(GL_RGBA, levels.data(), (GLuint)levels.size(), textype);
+			Streamer.Enqueue(texture, GL_RGBA, levels.data(), (GLuint)levels.size(), storage);
+		}
+		return texture;
+	}
+
+	// Couldn't be cooked, stream the decoded pixels as a single level
+	texture.Internal_Format = image->Alpha ? GL_RGBA : GL_RGB;
+	texture.Image_Format = GL_RGBA;
+	TextureLevel level = { (GLuint)image->Width, (GLuint)image->Height, image->Pixels, image->Width * image->Height * 4 };
+	if (image->Pixels == nullptr) {
+		texture.Generate(image->Width, image->Height, image->Pixels, textype);
+		return texture;
+	}
+	texture.Allocate(GL_RGBA, &level, 1, textype);
+	Streamer.Enqueue(texture, GL_RGBA, &level, 1, image);
+	return texture;
+}
@@ -1,74 +1,273 @@
-#pragma once
-
-#include <map>
-#include <string>
-#include <vector>
-
-#include <GL/glew.h>
-#include <assimp/scene.h>
-#include <glm/glm.hpp>
-
-#include "Texture.h"
-#include "Shader.h"
-#include "Mesh.h"
-
-using std::string;
-using std::map;
-using std::vector;
-
-struct ModelLamp {
-    glm::vec3 Position;
-    glm::vec3 Color;
-};
-
-struct ModelData {
-    vector<Mesh> meshes;
-    vector<ModelLamp> lamps;
-};
-
-struct AssimpMesh {
-    vector<MeshVertex> Vertices;
-    vector<GLuint> Indices;
-	vector<Texture2D> Textures;
-    glm::mat4x4 Transform;
-	glm::vec4 DiffuseColor;
-	glm::vec4 SpecularColor;
-	glm::vec4 AmbientColor;
-	glm::vec4 EmissiveColor;
-	glm::vec4 TransparentColor;
-};
-
-class ResourceManager
-{
-public:
-	static map<string, Shader> Shaders;
-	static map<string, Texture2D> Textures;
-	static map<string, ModelData> Models;
-
-	static Shader LoadShader(const GLchar* vShaderFile, const GLchar* fShaderFile, const GLchar* gShaderFile, string name);
-	static Shader GetShader(string name);
-	static Texture2D LoadTexture(const GLchar* file, string name, GLboolean alpha = GL_FALSE, Texture2D::TextureType textype = Texture2D::TextureType::DIFFUSE);
-	static Texture2D GetTexture(string name);
-	static ModelData LoadModelData(string filename, string name);
-	static ModelData GetModelData(string name);
-	
-	static void Clear();
-private:
-	ResourceManager() {}
-
-	static Shader loadShaderFromFile(const GLchar* vShaderFile, const GLchar* fShaderFile, const GLchar* gShaderFile = nullptr);
-	static Texture2D loadTextureFromFile(const GLchar* file, GLboolean alpha, Texture2D::TextureType textype);
-	static ModelData loadModelDataFromFile(std::string filename);
-
-	static void loadObjectsFromNode(const aiNode* node, const aiScene* scene, glm::mat4 currentTransform, vector<AssimpMesh>* assimpmeshes);
-	static vector<Texture2D> loadMaterialTextures(aiMaterial *mat, aiTextureType type);
-
-	static Texture2D::TextureType AiToTex2D(aiTextureType aiT);
-
-    static glm::mat4 AiToGlm(aiMatrix4x4 aiM);
-	static glm::vec2 AiToGlm(aiVector2D aiV);
-    static glm::vec3 AiToGlm(aiVector3D aiV);
-	static glm::vec4 AiToGlm(aiColor3D aiC);
-	static glm::vec4 AiToGlm(aiColor4D aiC);
-};
-
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+
+#include "Texture.h"
+#include "Shader.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include "MappedFile.h"
+#include "TextureStreamer.h"
+
+using std::string;
+using std::map;
+using std::vector;
+
+// A loaded shader's source, kept to compile feature variants of it on demand
+struct ShaderSource {
+    string Vertex, Fragment, Geometry;
+    bool HasGeometry = false;
+    // SHADER_* features the source has #ifdefs for
+    GLuint Features = 0;
+    // Variants compiled so far, by feature mask
+    map<GLuint, Shader> Variants;
+    // Variants the driver is still building, moved to Variants once finished
+    map<GLuint, Shader> Building;
+};
+
+struct ModelLamp {
+    glm::vec3 Position;
+    glm::vec3 Color;
+};
+
+struct ModelData {
+    vector<Mesh> meshes;
+    vector<ModelLamp> lamps;
+    // Union of the mesh bounds
+    BoundingBox Box;
+    BoundingSphere Sphere;
+
+    ModelData() {}
+    // The meshes own GL objects, so model data can only be moved, never copied
+    ModelData(const ModelData&) = delete;
+    ModelData& operator=(const ModelData&) = delete;
+    ModelData(ModelData&&) = default;
+    ModelData& operator=(ModelData&&) = default;
+    ~ModelData();
+};
+
+// Shared, immutable handle to loaded model data. Every Model drawing the same
+// asset holds one of these instead of its own copy of the meshes.
+typedef std::shared_ptr<const ModelData> ModelHandle;
+
+// Resolves to the model once it has been uploaded and published
+typedef std::shared_future<ModelHandle> ModelFuture;
+
+// Image decoded off the GL thread, waiting to be uploaded
+struct ImageData {
+    int Width = 0, Height = 0;
+    GLboolean Alpha = GL_FALSE;
+    unsigned char* Pixels = nullptr; // Owned RGBA from stbi_load, only kept if the image couldn't be cooked
+    // Hash of the encoded file and the format, spots the same image under different paths
+    uint64_t ContentHash = 0;
+
+    // Cooked mip chain, pointing into Mapping or Storage
+    GLenum Format = 0;
+    vector<TextureLevel> Levels;
+    std::shared_ptr<MappedFile> Mapping;
+    vector<unsigned char> Storage;
+
+    ImageData() {}
+    ImageData(const ImageData&) = delete;
+    ImageData& operator=(const ImageData&) = delete;
+    ~ImageData();
+
+    // Size of the image once it is on the GPU
+    size_t Bytes() const;
+};
+
+// A GL texture shared by every mesh that references the same image
+struct CachedTexture {
+    // Texture2D's default constructor creates a GL texture, so only build these from an uploaded one
+    CachedTexture(const Texture2D& texture) : Texture(texture) {}
+
+    Texture2D Texture;
+    uint64_t ContentHash = 0;
+    vector<string> Paths;
+    int References = 0;
+    size_t Bytes = 0;
+};
+
+// A texture referenced by an imported mesh
+struct TextureRef {
+    string Path;
+    Texture2D::TextureType Type;
+    std::shared_ptr<ImageData> Image; // Filled in by the decode step
+};
+
+struct AssimpMesh {
+    // Mesh in the Assimp scene the streams are built from, only valid during the import
+    const aiMesh* Source = nullptr;
+    vector<MeshVertex> Vertices;
+    vector<GLuint> Indices;
+	vector<TextureRef> Textures;
+    // Packed copies of Vertices/Indices, when packing
+    vector<PackedVertex> PackedVertices;
+    vector<uint16_t> ShortIndices;
+    // Index ranges of the levels of detail, Streams.Lods points here
+    vector<MeshLod> Lods;
+    // Streams to upload. Point into the vectors above after an import, or
+    // straight into the mapped cooked file when loaded from the cache.
+    MeshStreams Streams;
+    glm::mat4x4 Transform;
+    BoundingBox Box;
+    BoundingSphere Sphere;
+	glm::vec4 DiffuseColor;
+	glm::vec4 SpecularColor;
+	glm::vec4 AmbientColor;
+	glm::vec4 EmissiveColor;
+	glm::vec4 TransparentColor;
+};
+
+// A model on its way in. Parsing and image decoding happen on the worker
+// pool, then ProcessUploads feeds the result to the GL a mesh at a time.
+struct PendingModel {
+    string Name;
+    string Filename;
+    vector<AssimpMesh> Meshes; // Vertices already in model space
+    vector<ModelLamp> Lamps;
+    // Every file besides Filename the import tried to open, e.g. .mtl libraries
+    vector<string> Dependencies;
+    // Cooked file the mesh streams point into, if it came from the cache
+    std::shared_ptr<MappedFile> Cache;
+    // Worker jobs still running for this model
+    std::atomic<int> Outstanding;
+
+    // Upload progress, only touched on the GL thread
+    ModelData Result;
+    size_t NextMesh = 0;
+    std::promise<ModelHandle> Promise;
+    std::chrono::steady_clock::time_point Requested;
+};
+
+class ResourceManager
+{
+public:
+	static map<string, Shader> Shaders;
+	static map<string, Texture2D> Textures;
+	static map<string, ModelHandle> Models;
+
+	// Loads a shader and compiles its plain variant. features lists the SHADER_* bits
+	// the source can be specialised on, see GetShaderVariant.
+	static Shader LoadShader(const GLchar* vShaderFile, const GLchar* fShaderFile, const GLchar* gShaderFile, string name, GLuint features = 0);
+	static Shader GetShader(string name);
+	// The variant of a loaded shader with the given SHADER_* features, compiled the
+	// first time it is asked for. Features the shader wasn't loaded with are ignored.
+	// Blocks until the variant is built, see RequestShaderVariant for the non-blocking version.
+	static Shader GetShaderVariant(const string& name, GLuint features);
+	// Non-blocking GetShaderVariant. Starts building the variant the first time it is
+	// asked for and returns false until ProcessShaderBuilds has finished it, draw
+	// with a fallback variant in the meantime.
+	static bool RequestShaderVariant(const string& name, GLuint features, Shader& shader);
+	// Starts building every combination of a loaded shader's features at once
+	static void PrepareShaderVariants(const string& name);
+	// Finishes the variant builds the driver is done with, without waiting on the
+	// rest. Call once a frame on the GL thread.
+	static void ProcessShaderBuilds();
+	// The SHADER_* features a shader was loaded with
+	static GLuint ShaderFeatures(const string& name);
+	static Texture2D LoadTexture(const GLchar* file, string name, GLboolean alpha = GL_FALSE, Texture2D::TextureType textype = Texture2D::TextureType::DIFFUSE);
+	static Texture2D GetTexture(string name);
+	static ModelHandle LoadModelData(string filename, string name);
+	// Starts loading a model in the background. The future becomes ready once
+	// ProcessUploads has uploaded it, and GetModelData finds it from then on.
+	static ModelFuture LoadModelDataAsync(string filename, string name);
+	// Uploads finished background loads, stopping after roughly byteBudget bytes
+	// (at least one mesh goes up per call). Call once a frame on the GL thread.
+	static void ProcessUploads(size_t byteBudget);
+	static bool LoadsPending();
+	// Writes a cooked copy of every model in the directory, and of the textures
+	// they use, that doesn't have an up to date one. Needs no GL context.
+	// Returns the number of models that failed.
+	static int CookModels(string directory);
+	// Drops a reference to a material texture, deleting it once nothing uses it
+	static void ReleaseTexture(const Texture2D& texture);
+
+	// Material texture cache totals since startup
+	struct TextureCacheStats {
+		GLuint Hits = 0;
+		GLuint Misses = 0;
+		size_t BytesSaved = 0; // Decoded image data that didn't need uploading again
+		size_t BytesResident = 0;
+	};
+	static TextureCacheStats TextureStats;
+
+	// Every texture loaded from a file is streamed in through this. Call
+	// Streamer.Process once a frame on the GL thread.
+	static TextureStreamer Streamer;
+	// Vertex format models are imported and cooked in. Packed by default.
+	static VertexFormat MeshFormat;
+	// Returns an empty handle if no model was loaded under this name
+	static ModelHandle GetModelData(string name);
+	
+	static void Clear();
+private:
+	ResourceManager() {}
+
+	static ThreadPool& workers();
+	// Issues a variant's build and adds it to source.Building
+	static void startShaderVariant(ShaderSource& source, GLuint features);
+	// Models whose worker jobs are done, handed over to the GL thread
+	static vector<std::shared_ptr<PendingModel>> readyModels;
+	static std::mutex readyMutex;
+	// Models part way through uploading (GL thread only)
+	static std::deque<std::shared_ptr<PendingModel>> uploadQueue;
+	static int pendingLoads;
+
+	// Material textures by GL name, with lookups by path and by content.
+	// Written on the GL thread only, textureMutex guards reads from the workers.
+	static map<GLuint, CachedTexture> textureCache;
+	static map<string, GLuint> texturePaths;
+	static map<uint64_t, GLuint> textureContents;
+	static std::mutex textureMutex;
+	static bool textureCached(const string& path);
+	// Returns the shared texture for a reference, queuing it for streaming on a miss
+	static Texture2D acquireTexture(TextureRef& ref);
+
+	static map<string, ShaderSource> shaderSources;
+	static ShaderSource loadShaderFromFile(const GLchar* vShaderFile, const GLchar* fShaderFile, const GLchar* gShaderFile = nullptr);
+	static Texture2D loadTextureFromFile(const GLchar* file, GLboolean alpha, Texture2D::TextureType textype);
+	static ModelData loadModelDataFromFile(std::string filename);
+
+	// CPU side of a model load, safe to run on any thread. Leaves texture decoding to the caller.
+	// Reads the cooked copy when it is up to date, otherwise imports with Assimp and cooks it.
+	static bool parseModelFile(PendingModel& pending);
+	static bool importModelFile(PendingModel& pending);
+	// Builds one mesh's streams from its Source, baking in the node transform.
+	// Meshes don't share anything, so these run in parallel.
+	static void convertMesh(const string& filename, size_t index, AssimpMesh& mesh);
+	// GL side, uploads one mesh and returns the number of bytes sent. Its textures stream in separately.
+	static size_t uploadMesh(PendingModel& pending);
+	static void publishModel(PendingModel& pending);
+	static void finishWorkerJob(const std::shared_ptr<PendingModel>& pending);
+
+	static std::shared_ptr<ImageData> decodeImage(const GLchar* file, GLboolean alpha);
+	// Allocates the texture and hands its levels to the Streamer
+	static Texture2D uploadImage(const std::shared_ptr<ImageData>& image, Texture2D::TextureType textype);
+
+	static void loadObjectsFromNode(const aiNode* node, const aiScene* scene, glm::mat4 currentTransform, vector<AssimpMesh>* assimpmeshes);
+	static vector<TextureRef> loadMaterialTextures(aiMaterial *mat, aiTextureType type);
+
+	static void calculateModelBounds(ModelData& model);
+
+	static Texture2D::TextureType AiToTex2D(aiTextureType aiT);
+
+    static glm::mat4 AiToGlm(aiMatrix4x4 aiM);
+	static glm::vec2 AiToGlm(aiVector2D aiV);
+    static glm::vec3 AiToGlm(aiVector3D aiV);
+	static glm::vec4 AiToGlm(aiColor3D aiC);
+	static glm::vec4 AiToGlm(aiColor4D aiC);
+};
+
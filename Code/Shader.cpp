@@ -1,124 +1,385 @@
-#include "Shader.h"
-
-#include <iostream>
-
-Shader& Shader::Use()
-{
-	glUseProgram(this->ID);
-	return *this;
-}
-
-void Shader::Compile(const GLchar* vertexSource, const GLchar* fragmentSource, const GLchar* geometrySource)
-{
-	GLuint sVertex, sFragment, gShader;
-	auto a = 1;
-	// Vertex Shader
-	sVertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(sVertex, 1, &vertexSource, NULL);
-	glCompileShader(sVertex);
-	checkCompileErrors(sVertex, "VERTEX");
-	// Fragment Shader
-	sFragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(sFragment, 1, &fragmentSource, NULL);
-	glCompileShader(sFragment);
-	checkCompileErrors(sFragment, "FRAGMENT");
-	// If geometry shader source code is given, also compile geometry shader
-	if (geometrySource != nullptr)
-	{
-		gShader = glCreateShader(GL_GEOMETRY_SHADER);
-		glShaderSource(gShader, 1, &geometrySource, NULL);
-		glCompileShader(gShader);
-		checkCompileErrors(gShader, "GEOMETRY");
-	}
-	// Shader Program
-	this->ID = glCreateProgram();
-	glAttachShader(this->ID, sVertex);
-	glAttachShader(this->ID, sFragment);
-	if (geometrySource != nullptr)
-		glAttachShader(this->ID, gShader);
-	glLinkProgram(this->ID);
-	checkCompileErrors(this->ID, "PROGRAM");
-	// Delete the shaders as they're linked into our program now and no longer necessery
-	glDeleteShader(sVertex);
-	glDeleteShader(sFragment);
-	if (geometrySource != nullptr)
-		glDeleteShader(gShader);
-}
-
-void Shader::SetBool(const GLchar* name, GLboolean* value, GLsizei count, GLboolean useShader)
-{
-	auto BoolArray = new GLint[count];
-	for (unsigned int i=0; i<count; i++) {
-		BoolArray[i] = (GLint)value[i];
-	}
-	if (useShader)
-		this->Use();
-	glUniform1iv(glGetUniformLocation(this->ID, name), count, BoolArray);
-	delete[] BoolArray;
-}
-
-void Shader::SetFloat(const GLchar* name, GLfloat* value, GLsizei count, GLboolean useShader)
-{
-	if (useShader)
-		this->Use();
-	glUniform1fv(glGetUniformLocation(this->ID, name), count, value);
-}
-void Shader::SetInteger(const GLchar* name, GLint* value, GLsizei count, GLboolean useShader)
-{
-	if (useShader)
-		this->Use();
-	glUniform1iv(glGetUniformLocation(this->ID, name), count, value);
-}
-void Shader::SetVector2f(const GLchar* name, glm::vec2* value, GLsizei count, GLboolean useShader)
-{
-	if (useShader)
-		this->Use();
-	glUniform2fv(glGetUniformLocation(this->ID, name), count, (GLfloat*)value);
-}
-void Shader::SetVector3f(const GLchar* name, glm::vec3* value, GLsizei count, GLboolean useShader)
-{
-	if (useShader)
-		this->Use();
-	glUniform3fv(glGetUniformLocation(this->ID, name), count, (GLfloat*)value);
-}
-void Shader::SetVector4f(const GLchar* name, glm::vec4* value, GLsizei count, GLboolean useShader)
-{
-	if (useShader)
-		this->Use();
-	glUniform4fv(glGetUniformLocation(this->ID, name), count, (GLfloat*)value);
-}
-void Shader::SetMatrix4(const GLchar* name, glm::mat4* matrix, GLsizei count, GLboolean useShader)
-{
-	if (useShader)
-		this->Use();
-	glUniformMatrix4fv(glGetUniformLocation(this->ID, name), count, GL_FALSE, (GLfloat*)matrix);
-}
-
-
-void Shader::checkCompileErrors(GLuint object, std::string type)
-{
-	GLint success;
-	GLchar infoLog[1024];
-	if (type != "PROGRAM")
-	{
-		glGetShaderiv(object, GL_COMPILE_STATUS, &success);
-		if (!success)
-		{
-			glGetShaderInfoLog(object, 1024, NULL, infoLog);
-			std::cout << "| ERROR::SHADER: Compile-time error: Type: " << type << "\n"
-				<< infoLog << "\n -- --------------------------------------------------- -- "
-				<< std::endl;
-		}
-	}
-	else
-	{
-		glGetProgramiv(object, GL_LINK_STATUS, &success);
-		if (!success)
-		{
-			glGetProgramInfoLog(object, 1024, NULL, infoLog);
-			std::cout << "| ERROR::Shader: Link-time error: Type: " << type << "\n"
-				<< infoLog << "\n -- --------------------------------------------------- -- "
-				<< std::endl;
-		}
-	}
+#include "Shader.h"
+#include "ProgramCache.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+Shader::Stats Shader::FrameStats = {};
+std::map<std::string, GLuint> Shader::blockBindings;
+std::map<std::string, GLint> Shader::samplerUnits;
+
+static const char* FEATURE_NAMES[SHADER_FEATURE_COUNT] = { "DIFFUSE_MAP", "SPECULAR_MAP", "INSTANCED" };
+
+// Defines have to come after the #version line, which has to be the first thing in the source
+static std::string injectDefines(const GLchar* source, const std::string& defines)
+{
+	std::string code(source);
+	if (defines.empty())
+		return code;
+	size_t version = code.find("#version");
+	size_t insert = version == std::string::npos ? 0 : code.find('\n', version);
+	if (insert == std::string::npos)
+		return code + "\n" + defines;
+	if (version != std::string::npos)
+		insert++;
+	return code.insert(insert, defines);
+}
+
+void Shader::ResetStats()
+{
+	FrameStats = Stats{};
+}
+
+void Shader::RegisterUniformBlock(const std::string& name, GLuint binding)
+{
+	blockBindings[name] = binding;
+}
+
+void Shader::RegisterSampler(const std::string& name, GLint unit)
+{
+	samplerUnits[name] = unit;
+}
+
+std::string Shader::FeatureDefines(GLuint features)
+{
+	std::string defines;
+	for (int i = 0; i < SHADER_FEATURE_COUNT; i++) {
+		if (features & (1 << i))
+			defines += std::string("#define ") + FEATURE_NAMES[i] + "\n";
+	}
+	return defines;
+}
+
+Shader& Shader::Use()
+{
+	glUseProgram(this->ID);
+	return *this;
+}
+
+bool Shader::ParallelCompileSupported()
+{
+	static int supported = -1;
+	if (supported < 0) {
+		supported = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile ? 1 : 0;
+		// Lets the driver pick how many threads to use
+		if (GLEW_KHR_parallel_shader_compile)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		else if (GLEW_ARB_parallel_shader_compile)
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+	}
+	return supported == 1;
+}
+
+void Shader::Compile(const GLchar* vertexSource, const GLchar* fragmentSource, const GLchar* geometrySource, GLuint features)
+{
+	this->BeginCompile(vertexSource, fragmentSource, geometrySource, features);
+	this->FinishCompile();
+}
+
+void Shader::BeginCompile(const GLchar* vertexSource, const GLchar* fragmentSource, const GLchar* geometrySource, GLuint features)
+{
+	auto start = std::chrono::steady_clock::now();
+	ParallelCompileSupported();
+	std::string defines = FeatureDefines(features);
+	std::string vertexCode = injectDefines(vertexSource, defines);
+	std::string fragmentCode = injectDefines(fragmentSource, defines);
+	std::string geometryCode = geometrySource != nullptr ? injectDefines(geometrySource, defines) : std::string();
+	vertexSource = vertexCode.c_str();
+	fragmentSource = fragmentCode.c_str();
+	if (geometrySource != nullptr)
+		geometrySource = geometryCode.c_str();
+
+	this->ID = glCreateProgram();
+	this->uniforms.reset();
+	this->pending.reset();
+	// A cached binary skips compiling and linking altogether
+	bool cacheable = ProgramCache::Supported();
+	uint64_t key = cacheable ? ProgramCache::Key(vertexCode, fragmentCode, geometryCode) : 0;
+	if (cacheable && ProgramCache::Load(key, this->ID)) {
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		ProgramCache::LoadStats.Loaded++;
+		ProgramCache::LoadStats.LoadMs += elapsed.count();
+		this->reflectUniforms();
+		this->bindUniformBlocks();
+		this->bindSamplers();
+		return;
+	}
+
+	// Nothing here asks for a status, so none of it waits on the driver
+	auto build = std::make_shared<PendingBuild>();
+	build->Cacheable = cacheable;
+	build->Key = key;
+	const GLchar* sources[3] = { vertexSource, fragmentSource, geometrySource };
+	const GLenum types[3] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+	const char* names[3] = { "VERTEX", "FRAGMENT", "GEOMETRY" };
+	// Geometry shader is optional
+	for (int i = 0; i < 3 && sources[i] != nullptr; i++) {
+		GLuint stage = glCreateShader(types[i]);
+		glShaderSource(stage, 1, &sources[i], NULL);
+		glCompileShader(stage);
+		glAttachShader(this->ID, stage);
+		build->Stages[build->StageCount] = stage;
+		build->StageTypes[build->StageCount] = names[i];
+		build->StageCount++;
+	}
+	// Shader Program, a failed binary load leaves it free to link as normal
+	if (cacheable)
+		glProgramParameteri(this->ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(this->ID);
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	build->IssueMs = elapsed.count();
+	this->pending = build;
+}
+
+bool Shader::CompileReady() const
+{
+	if (!this->pending || !ParallelCompileSupported())
+		return true;
+	// The link only completes once every stage has compiled
+	GLint complete = GL_FALSE;
+	glGetProgramiv(this->ID, GL_COMPLETION_STATUS_KHR, &complete);
+	return complete == GL_TRUE;
+}
+
+void Shader::FinishCompile()
+{
+	if (!this->pending)
+		return;
+	auto start = std::chrono::steady_clock::now();
+	PendingBuild& build = *this->pending;
+	for (int i = 0; i < build.StageCount; i++)
+		checkCompileErrors(build.Stages[i], build.StageTypes[i]);
+	checkCompileErrors(this->ID, "PROGRAM");
+	// Delete the shaders as they're linked into our program now and no longer necessery
+	for (int i = 0; i < build.StageCount; i++)
+		glDeleteShader(build.Stages[i]);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(this->ID, GL_LINK_STATUS, &linked);
+	if (build.Cacheable && linked == GL_TRUE)
+		ProgramCache::Write(build.Key, this->ID);
+	this->reflectUniforms();
+	this->bindUniformBlocks();
+	this->bindSamplers();
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	ProgramCache::LoadStats.Compiled++;
+	ProgramCache::LoadStats.CompileMs += build.IssueMs + elapsed.count();
+	this->pending.reset();
+}
+
+void Shader::bindUniformBlocks()
+{
+	for (auto& block : blockBindings) {
+		GLuint index = glGetUniformBlockIndex(this->ID, block.first.c_str());
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(this->ID, index, block.second);
+	}
+}
+
+void Shader::reflectUniforms()
+{
+	auto table = std::make_shared<UniformTable>();
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(this->ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<GLchar> nameBuffer(maxLength + 1);
+	for (GLint i = 0; i < count; i++) {
+		GLsizei length;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(this->ID, i, (GLsizei)nameBuffer.size(), &length, &size, &type, &nameBuffer[0]);
+		std::string name(&nameBuffer[0], length);
+		// Arrays are reported as "name[0]", register the bare name as well as every element
+		bool isArray = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+		if (isArray)
+			name.erase(name.size() - 3);
+		FrameStats.DriverLookups++;
+		GLint location = glGetUniformLocation(this->ID, name.c_str());
+		// Members of uniform blocks have no location
+		if (location < 0)
+			continue;
+		(*table)[name] = location;
+		if (isArray) {
+			for (GLint element = 0; element < size; element++) {
+				std::string elementName = name + "[" + std::to_string(element) + "]";
+				FrameStats.DriverLookups++;
+				(*table)[elementName] = glGetUniformLocation(this->ID, elementName.c_str());
+			}
+		}
+	}
+	this->uniforms = table;
+}
+
+void Shader::bindSamplers()
+{
+	// Sampler units are program state, so they only need setting once
+	this->Use();
+	for (auto& sampler : samplerUnits) {
+		this->SetInteger(this->GetUniform(sampler.first), &sampler.second);
+	}
+	glUseProgram(0);
+}
+
+UniformId Shader::GetUniform(const GLchar* name) const
+{
+	return this->GetUniform(std::string(name));
+}
+
+UniformId Shader::GetUniform(const std::string& name) const
+{
+	UniformId id;
+	FrameStats.TableLookups++;
+	if (this->uniforms) {
+		auto iter = this->uniforms->find(name);
+		if (iter != this->uniforms->end())
+			id.Location = iter->second;
+	}
+	return id;
+}
+
+void Shader::SetBool(const GLchar* name, GLboolean* value, GLsizei count, GLboolean useShader)
+{
+	if (useShader)
+		this->Use();
+	this->SetBool(this->GetUniform(name), value, count);
+}
+
+void Shader::SetFloat(const GLchar* name, GLfloat* value, GLsizei count, GLboolean useShader)
+{
+	if (useShader)
+		this->Use();
+	this->SetFloat(this->GetUniform(name), value, count);
+}
+void Shader::SetInteger(const GLchar* name, GLint* value, GLsizei count, GLboolean useShader)
+{
+	if (useShader)
+		this->Use();
+	this->SetInteger(this->GetUniform(name), value, count);
+}
+void Shader::SetVector2f(const GLchar* name, glm::vec2* value, GLsizei count, GLboolean useShader)
+{
+	if (useShader)
+		this->Use();
+	this->SetVector2f(this->GetUniform(name), value, count);
+}
+void Shader::SetVector3f(const GLchar* name, glm::vec3* value, GLsizei count, GLboolean useShader)
+{
+	if (useShader)
+		this->Use();
+	this->SetVector3f(this->GetUniform(name), value, count);
+}
+void Shader::SetVector4f(const GLchar* name, glm::vec4* value, GLsizei count, GLboolean useShader)
+{
+	if (useShader)
+		this->Use();
+	this->SetVector4f(this->GetUniform(name), value, count);
+}
+void Shader::SetMatrix3(const GLchar* name, glm::mat3* matrix, GLsizei count, GLboolean useShader)
+{
+	if (useShader)
+		this->Use();
+	this->SetMatrix3(this->GetUniform(name), matrix, count);
+}
+void Shader::SetMatrix4(const GLchar* name, glm::mat4* matrix, GLsizei count, GLboolean useShader)
+{
+	if (useShader)
+		this->Use();
+	this->SetMatrix4(this->GetUniform(name), matrix, count);
+}
+
+void Shader::SetBool(UniformId id, const GLboolean* value, GLsizei count)
+{
+	if (!id.Valid())
+		return;
+	// Bools are uploaded as ints, convert on the stack for the common small arrays
+	GLint stackArray[16];
+	GLint* boolArray = count <= 16 ? stackArray : new GLint[count];
+	for (GLsizei i=0; i<count; i++) {
+		boolArray[i] = (GLint)value[i];
+	}
+	FrameStats.UniformSets++;
+	glUniform1iv(id.Location, count, boolArray);
+	if (boolArray != stackArray)
+		delete[] boolArray;
+}
+void Shader::SetFloat(UniformId id, const GLfloat* value, GLsizei count)
+{
+	if (!id.Valid())
+		return;
+	FrameStats.UniformSets++;
+	glUniform1fv(id.Location, count, value);
+}
+void Shader::SetInteger(UniformId id, const GLint* value, GLsizei count)
+{
+	if (!id.Valid())
+		return;
+	FrameStats.UniformSets++;
+	glUniform1iv(id.Location, count, value);
+}
+void Shader::SetVector2f(UniformId id, const glm::vec2* value, GLsizei count)
+{
+	if (!id.Valid())
+		return;
+	FrameStats.UniformSets++;
+	glUniform2fv(id.Location, count, (const GLfloat*)value);
+}
+void Shader::SetVector3f(UniformId id, const glm::vec3* value, GLsizei count)
+{
+	if (!id.Valid())
+		return;
+	FrameStats.UniformSets++;
+	glUniform3fv(id.Location, count, (const GLfloat*)value);
+}
+void Shader::SetVector4f(UniformId id, const glm::vec4* value, GLsizei count)
+{
+	if (!id.Valid())
+		return;
+	FrameStats.UniformSets++;
+	glUniform4fv(id.Location, count, (const GLfloat*)value);
+}
+void Shader::SetMatrix3(UniformId id, const glm::mat3* matrix, GLsizei count)
+{
+	if (!id.Valid())
+		return;
+	FrameStats.UniformSets++;
+	glUniformMatrix3fv(id.Location, count, GL_FALSE, (const GLfloat*)matrix);
+}
+void Shader::SetMatrix4(UniformId id, const glm::mat4* matrix, GLsizei count)
+{
+	if (!id.Valid())
+		return;
+	FrameStats.UniformSets++;
+	glUniformMatrix4fv(id.Location, count, GL_FALSE, (const GLfloat*)matrix);
+}
+
+
+void Shader::checkCompileErrors(GLuint object, std::string type)
+{
+	GLint success;
+	GLchar infoLog[1024];
+	if (type != "PROGRAM")
+	{
+		glGetShaderiv(object, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(object, 1024, NULL, infoLog);
+			std::cout << "| ERROR::SHADER: Compile-time error: Type: " << type << "\n"
+				<< infoLog << "\n -- --------------------------------------------------- -- "
+				<< std::endl;
+		}
+	}
+	else
+	{
+		glGetProgramiv(object, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(object, 1024, NULL, infoLog);
+			std::cout << "| ERROR::Shader: Link-time error: Type: " << type << "\n"
+				<< infoLog << "\n -- --------------------------------------------------- -- "
+				<< std::endl;
+		}
+	}
 }
\ No newline at end of file
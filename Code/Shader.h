@@ -1,36 +1,117 @@
-#pragma once
-
-#include <string>
-
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
-#include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
-
-
-// General purpsoe shader object. Compiles from file, generates
-// compile/link-time error messages and hosts several utility 
-// functions for easy management.
-class Shader
-{
-public:
-	// State
-	GLuint ID;
-	// Constructor
-	Shader() { }
-	// Sets the current shader as active
-	Shader& Use();
-	// Compiles the shader from given source code
-	void    Compile(const GLchar* vertexSource, const GLchar* fragmentSource, const GLchar* geometrySource = nullptr); // Note: geometry source code is optional 
-	// Utility functions
-	void    SetBool(const GLchar* name, GLboolean* value, GLsizei = 1, GLboolean useShader = false);
-	void    SetFloat(const GLchar* name, GLfloat* value, GLsizei = 1, GLboolean useShader = false);
-	void    SetInteger(const GLchar* name, GLint* value, GLsizei = 1, GLboolean useShader = false);
-	void    SetVector2f(const GLchar* name, glm::vec2* value, GLsizei = 1, GLboolean useShader = false);
-	void    SetVector3f(const GLchar* name, glm::vec3* value, GLsizei = 1, GLboolean useShader = false);
-	void    SetVector4f(const GLchar* name, glm::vec4* value, GLsizei = 1, GLboolean useShader = false);
-	void    SetMatrix4(const GLchar* name, glm::mat4* matrix, GLsizei = 1, GLboolean useShader = false);
-private:
-	// Checks if compilation or linking failed and if so, print the error logs
-	void    checkCompileErrors(GLuint object, std::string type);
+#pragma once
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <map>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Features a shader can be specialised on. Each is compiled in as a #define
+// of the same name without the SHADER_ prefix, e.g. SHADER_INSTANCED -> INSTANCED.
+#define SHADER_DIFFUSE_MAP 0x1
+#define SHADER_SPECULAR_MAP 0x2
+#define SHADER_INSTANCED 0x4
+#define SHADER_FEATURE_COUNT 3
+
+// Handle to a uniform location inside one shader program. Resolve it once
+// with Shader::GetUniform and reuse it; setting an invalid id is a no-op.
+struct UniformId {
+	GLint Location = -1;
+
+	bool Valid() const { return Location >= 0; }
+};
+
+// General purpsoe shader object. Compiles from file, generates
+// compile/link-time error messages and hosts several utility 
+// functions for easy management.
+class Shader
+{
+public:
+	// Name -> location table, shared between copies of the same program
+	typedef std::unordered_map<std::string, GLint> UniformTable;
+
+	// Per-frame uniform counters, for checking the location table is doing its job
+	struct Stats {
+		GLuint DriverLookups; // glGetUniformLocation calls
+		GLuint TableLookups; // Name lookups answered by the reflection table
+		GLuint UniformSets; // glUniform* calls
+	};
+	static Stats FrameStats;
+	static void ResetStats();
+
+	// Binds the named uniform block to a buffer binding point in every shader compiled afterwards
+	static void RegisterUniformBlock(const std::string& name, GLuint binding);
+	// Fixes a sampler uniform to a texture unit in every shader compiled afterwards
+	static void RegisterSampler(const std::string& name, GLint unit);
+	// The #define lines for a set of SHADER_* features
+	static std::string FeatureDefines(GLuint features);
+	// Whether the driver compiles and links on its own threads (GL_KHR_parallel_shader_compile)
+	static bool ParallelCompileSupported();
+
+	// State
+	GLuint ID;
+	// Constructor
+	Shader() { }
+	// Sets the current shader as active
+	Shader& Use();
+	// Compiles the shader from given source code, with the given SHADER_* features defined in every stage
+	void    Compile(const GLchar* vertexSource, const GLchar* fragmentSource, const GLchar* geometrySource = nullptr, GLuint features = 0); // Note: geometry source code is optional 
+	// Compile split in two: BeginCompile hands every stage and the link to the driver
+	// without asking for any status, CompileReady polls without blocking, and
+	// FinishCompile checks the logs and sets the program up. Issue all builds before
+	// finishing any of them so the driver can work on them together. Without parallel
+	// compile support CompileReady is always true and FinishCompile blocks instead.
+	void    BeginCompile(const GLchar* vertexSource, const GLchar* fragmentSource, const GLchar* geometrySource = nullptr, GLuint features = 0);
+	bool    CompileReady() const;
+	void    FinishCompile();
+	// Looks up a uniform in the reflection table. Array elements are addressed as "name[i]".
+	UniformId GetUniform(const GLchar* name) const;
+	UniformId GetUniform(const std::string& name) const;
+	// Utility functions
+	void    SetBool(const GLchar* name, GLboolean* value, GLsizei = 1, GLboolean useShader = false);
+	void    SetFloat(const GLchar* name, GLfloat* value, GLsizei = 1, GLboolean useShader = false);
+	void    SetInteger(const GLchar* name, GLint* value, GLsizei = 1, GLboolean useShader = false);
+	void    SetVector2f(const GLchar* name, glm::vec2* value, GLsizei = 1, GLboolean useShader = false);
+	void    SetVector3f(const GLchar* name, glm::vec3* value, GLsizei = 1, GLboolean useShader = false);
+	void    SetVector4f(const GLchar* name, glm::vec4* value, GLsizei = 1, GLboolean useShader = false);
+	void    SetMatrix3(const GLchar* name, glm::mat3* matrix, GLsizei = 1, GLboolean useShader = false);
+	void    SetMatrix4(const GLchar* name, glm::mat4* matrix, GLsizei = 1, GLboolean useShader = false);
+	// Handle based versions of the above, for hot paths
+	void    SetBool(UniformId id, const GLboolean* value, GLsizei = 1);
+	void    SetFloat(UniformId id, const GLfloat* value, GLsizei = 1);
+	void    SetInteger(UniformId id, const GLint* value, GLsizei = 1);
+	void    SetVector2f(UniformId id, const glm::vec2* value, GLsizei = 1);
+	void    SetVector3f(UniformId id, const glm::vec3* value, GLsizei = 1);
+	void    SetVector4f(UniformId id, const glm::vec4* value, GLsizei = 1);
+	void    SetMatrix3(UniformId id, const glm::mat3* matrix, GLsizei = 1);
+	void    SetMatrix4(UniformId id, const glm::mat4* matrix, GLsizei = 1);
+private:
+	// A build between BeginCompile and FinishCompile
+	struct PendingBuild {
+		GLuint Stages[3];
+		const char* StageTypes[3];
+		int StageCount = 0;
+		bool Cacheable = false;
+		uint64_t Key = 0;
+		double IssueMs = 0; // Time spent issuing, the wait for the driver isn't counted
+	};
+
+	static std::map<std::string, GLuint> blockBindings;
+	static std::map<std::string, GLint> samplerUnits;
+
+	std::shared_ptr<const UniformTable> uniforms;
+	// Null once the program is set up, or when it came straight from the binary cache
+	std::shared_ptr<PendingBuild> pending;
+
+	// Checks if compilation or linking failed and if so, print the error logs
+	void    checkCompileErrors(GLuint object, std::string type);
+	// Fills the uniform table from the program's active uniforms
+	void    reflectUniforms();
+	// Applies the registered uniform block bindings and sampler units
+	void    bindUniformBlocks();
+	void    bindSamplers();
 };
\ No newline at end of file
@@ -1,32 +1,87 @@
-#include "Texture.h"
-
-#include <iostream>
-
-
-Texture2D::Texture2D()
-	: Width(0), Height(0), Internal_Format(GL_RGB), Image_Format(GL_RGB), Wrap_S(GL_REPEAT), Wrap_T(GL_REPEAT), Filter_Min(GL_LINEAR), Filter_Max(GL_LINEAR)
-{
-	glGenTextures(1, &this->ID);
-}
-
-void Texture2D::Generate(GLuint width, GLuint height, unsigned char* data, TextureType type)
-{
-	this->Type = type;
-	this->Width = width;
-	this->Height = height;
-	// Create Texture
-	glBindTexture(GL_TEXTURE_2D, this->ID);
-	glTexImage2D(GL_TEXTURE_2D, 0, this->Internal_Format, width, height, 0, this->Image_Format, GL_UNSIGNED_BYTE, data);
-	// Set Texture wrap and filter modes
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, this->Wrap_S);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, this->Wrap_T);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, this->Filter_Min);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, this->Filter_Max);
-	// Unbind texture
-	glBindTexture(GL_TEXTURE_2D, 0);
-}
-
-void Texture2D::Bind() const
-{
-	glBindTexture(GL_TEXTURE_2D, this->ID);
+#include "Texture.h"
+
+#include <iostream>
+
+
+Texture2D::Texture2D()
+	: Width(0), Height(0), Internal_Format(GL_RGB), Image_Format(GL_RGB), Wrap_S(GL_REPEAT), Wrap_T(GL_REPEAT), Filter_Min(GL_LINEAR), Filter_Max(GL_LINEAR)
+{
+	glGenTextures(1, &this->ID);
+}
+
+void Texture2D::Generate(GLuint width, GLuint height, unsigned char* data, TextureType type)
+{
+	this->Type = type;
+	this->Width = width;
+	this->Height = height;
+	// Create Texture
+	glBindTexture(GL_TEXTURE_2D, this->ID);
+	glTexImage2D(GL_TEXTURE_2D, 0, this->Internal_Format, width, height, 0, this->Image_Format, GL_UNSIGNED_BYTE, data);
+	// Set Texture wrap and filter modes
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, this->Wrap_S);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, this->Wrap_T);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, this->Filter_Min);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, this->Filter_Max);
+	// Unbind texture
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture2D::Generate(GLenum format, const TextureLevel* levels, GLuint levelCount, TextureType type)
+{
+	this->Type = type;
+	this->Width = levels[0].Width;
+	this->Height = levels[0].Height;
+	bool compressed = IsCompressed(format);
+	if (compressed)
+		this->Internal_Format = format;
+	glBindTexture(GL_TEXTURE_2D, this->ID);
+	for (GLuint level = 0; level < levelCount; level++) {
+		const TextureLevel& mip = levels[level];
+		if (compressed)
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, mip.Width, mip.Height, 0, mip.Size, mip.Data);
+		else
+			glTexImage2D(GL_TEXTURE_2D, level, this->Internal_Format, mip.Width, mip.Height, 0, this->Image_Format, GL_UNSIGNED_BYTE, mip.Data);
+	}
+	// Stops the driver expecting levels that were never provided
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, this->Wrap_S);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, this->Wrap_T);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, this->Filter_Min);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, this->Filter_Max);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture2D::Allocate(GLenum format, const TextureLevel* levels, GLuint levelCount, TextureType type)
+{
+	this->Type = type;
+	this->Width = levels[0].Width;
+	this->Height = levels[0].Height;
+	bool compressed = IsCompressed(format);
+	if (compressed)
+		this->Internal_Format = format;
+	glBindTexture(GL_TEXTURE_2D, this->ID);
+	for (GLuint level = 0; level < levelCount; level++) {
+		const TextureLevel& mip = levels[level];
+		if (compressed)
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, mip.Width, mip.Height, 0, mip.Size, nullptr);
+		else
+			glTexImage2D(GL_TEXTURE_2D, level, this->Internal_Format, mip.Width, mip.Height, 0, this->Image_Format, GL_UNSIGNED_BYTE, nullptr);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, this->Wrap_S);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, this->Wrap_T);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, this->Filter_Min);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, this->Filter_Max);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool Texture2D::IsCompressed(GLenum format)
+{
+	return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+void Texture2D::Bind() const
+{
+	glBindTexture(GL_TEXTURE_2D, this->ID);
 }
\ No newline at end of file
@@ -1,37 +1,51 @@
-#pragma once
-
-#include <GL/glew.h>
-
-#define MAX_TEXTURES 8
-
-class Texture2D
-{
-private:
-	static constexpr char* const TypeStr[] = { "diffuse", "specular" };
-public:
-	enum TextureType { DIFFUSE = 0, SPECULAR };
-	TextureType Type;
-
-	// Holds the ID of the texture object, used for all texture operations to reference to this particlar texture
-	GLuint ID;
-	// Texture image dimensions
-	GLuint Width, Height; // Width and height of loaded image in pixels
-	// Texture Format
-	GLuint Internal_Format; // Format of texture object
-	GLuint Image_Format; // Format of loaded image
-	// Texture configuration
-	GLuint Wrap_S; // Wrapping mode on S axis
-	GLuint Wrap_T; // Wrapping mode on T axis
-	GLuint Filter_Min; // Filtering mode if texture pixels < screen pixels
-	GLuint Filter_Max; // Filtering mode if texture pixels > screen pixels
-	// Constructor (sets default texture modes)
-	Texture2D();
-	// Generates texture from image data
-	void Generate(GLuint width, GLuint height, unsigned char* data, TextureType type);
-	// Binds the texture as the current active GL_TEXTURE_2D texture object
-	void Bind() const;
-
-	const char* GetTypeStr() {
-		return TypeStr[Type];
-	}
+#pragma once
+
+#include <GL/glew.h>
+
+#define MAX_TEXTURES 8
+
+// One level of a prepared mip chain
+struct TextureLevel {
+	GLuint Width, Height;
+	const unsigned char* Data;
+	GLsizei Size; // Bytes, only needed for compressed formats
+};
+
+class Texture2D
+{
+private:
+	static constexpr char* const TypeStr[] = { "diffuse", "specular" };
+public:
+	enum TextureType { DIFFUSE = 0, SPECULAR };
+	TextureType Type;
+
+	// Holds the ID of the texture object, used for all texture operations to reference to this particlar texture
+	GLuint ID;
+	// Texture image dimensions
+	GLuint Width, Height; // Width and height of loaded image in pixels
+	// Texture Format
+	GLuint Internal_Format; // Format of texture object
+	GLuint Image_Format; // Format of loaded image
+	// Texture configuration
+	GLuint Wrap_S; // Wrapping mode on S axis
+	GLuint Wrap_T; // Wrapping mode on T axis
+	GLuint Filter_Min; // Filtering mode if texture pixels < screen pixels
+	GLuint Filter_Max; // Filtering mode if texture pixels > screen pixels
+	// Constructor (sets default texture modes)
+	Texture2D();
+	// Generates texture from image data
+	void Generate(GLuint width, GLuint height, unsigned char* data, TextureType type);
+	// Generates texture from a full mip chain. Compressed formats are uploaded as they are,
+	// anything else is read as Image_Format pixels.
+	void Generate(GLenum format, const TextureLevel* levels, GLuint levelCount, TextureType type);
+	// Creates storage for every level without filling any, for TextureStreamer to upload into.
+	// Sampling is limited to the smallest level until the streamer lowers the base level.
+	void Allocate(GLenum format, const TextureLevel* levels, GLuint levelCount, TextureType type);
+	static bool IsCompressed(GLenum format);
+	// Binds the texture as the current active GL_TEXTURE_2D texture object
+	void Bind() const;
+
+	const char* GetTypeStr() {
+		return TypeStr[Type];
+	}
 };
\ No newline at end of file
@@ -0,0 +1,417 @@
+#include "TextureCooker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "MappedFile.h"
+#include "Util.h"
+
+const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const uint32_t KTX_ENDIANNESS = 0x04030201;
+// Key/value entry holding the content hash the file was cooked from
+const char SOURCE_KEY[] = "LightRoom.SourceHash";
+
+struct KTXHeader {
+    unsigned char Identifier[12];
+    uint32_t Endianness;
+    uint32_t GLType;
+    uint32_t GLTypeSize;
+    uint32_t GLFormat;
+    uint32_t GLInternalFormat;
+    uint32_t GLBaseInternalFormat;
+    uint32_t PixelWidth;
+    uint32_t PixelHeight;
+    uint32_t PixelDepth;
+    uint32_t ArrayElements;
+    uint32_t Faces;
+    uint32_t MipLevels;
+    uint32_t KeyValueBytes;
+};
+
+// The key/value block is a single entry: size, key with terminator, value, padding to 4
+const uint32_t KEY_VALUE_SIZE = sizeof(SOURCE_KEY) + sizeof(uint64_t);
+const uint32_t KEY_VALUE_BYTES = (sizeof(uint32_t) + KEY_VALUE_SIZE + 3) & ~3u;
+
+// Hash stored in cooked files, changes when the cooker does
+static uint64_t cookKey(uint64_t contentHash) {
+    uint32_t version = TextureCooker::VERSION;
+    return Util::hash_bytes(&version, sizeof(version), contentHash);
+}
+
+static size_t blockBytes(GLenum format) {
+    return format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 16 : 8;
+}
+
+static size_t levelSize(GLenum format, GLuint width, GLuint height) {
+    return ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+static uint16_t packColor(int r, int g, int b) {
+    return (uint16_t)((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+}
+
+static void unpackColor(uint16_t color, int* rgb) {
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+string TextureCooker::CachePath(const string& source) {
+    return Util::cache_path(source, ".ktx");
+}
+
+bool TextureCooker::Load(const string& source, uint64_t contentHash, ImageData& image) {
+    auto file = std::make_shared<MappedFile>();
+    if (contentHash == 0 || !file->Open(CachePath(source))) return false;
+    if (!parseKTX(file->Data(), file->Size(), contentHash, image)) return false;
+    image.Mapping = file;
+    return true;
+}
+
+bool TextureCooker::parseKTX(const unsigned char* data, size_t size, uint64_t contentHash, ImageData& image) {
+    if (size < sizeof(KTXHeader)) return false;
+    const KTXHeader* header = (const KTXHeader*)data;
+    if (memcmp(header->Identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0 || header->Endianness != KTX_ENDIANNESS) return false;
+    GLenum format = header->GLInternalFormat;
+    if (!Texture2D::IsCompressed(format) || header->Faces != 1 || header->ArrayElements != 0 || header->PixelDepth != 0) return false;
+    if (header->MipLevels == 0 || header->PixelWidth == 0 || header->PixelHeight == 0) return false;
+
+    // Find the source hash among the key/value pairs
+    size_t offset = sizeof(KTXHeader);
+    size_t keyValueEnd = offset + header->KeyValueBytes;
+    if (keyValueEnd > size) return false;
+    bool current = false;
+    while (offset + sizeof(uint32_t) <= keyValueEnd) {
+        uint32_t entrySize;
+        memcpy(&entrySize, data + offset, sizeof(entrySize));
+        const unsigned char* entry = data + offset + sizeof(uint32_t);
+        if (offset + sizeof(uint32_t) + entrySize > keyValueEnd) return false;
+        if (entrySize == KEY_VALUE_SIZE && memcmp(entry, SOURCE_KEY, sizeof(SOURCE_KEY)) == 0) {
+            uint64_t hash;
+            memcpy(&hash, entry + sizeof(SOURCE_KEY), sizeof(hash));
+            current = hash == cookKey(contentHash);
+        }
+        offset += (sizeof(uint32_t) + entrySize + 3) & ~(size_t)3;
+    }
+    if (!current) return false;
+
+    offset = keyValueEnd;
+    vector<TextureLevel> levels;
+    for (uint32_t i=0; i<header->MipLevels; i++) {
+        TextureLevel level;
+        level.Width = std::max(1u, header->PixelWidth >> i);
+        level.Height = std::max(1u, header->PixelHeight >> i);
+        uint32_t imageSize;
+        if (offset + sizeof(imageSize) > size) return false;
+        memcpy(&imageSize, data + offset, sizeof(imageSize));
+        offset += sizeof(imageSize);
+        if (imageSize != levelSize(format, level.Width, level.Height) || offset + imageSize > size) return false;
+        level.Data = data + offset;
+        level.Size = (GLsizei)imageSize;
+        levels.push_back(level);
+        offset += (imageSize + 3) & ~3u;
+    }
+
+    image.Width = header->PixelWidth;
+    image.Height = header->PixelHeight;
+    image.Format = format;
+    image.Levels = levels;
+    return true;
+}
+
+bool TextureCooker::Cook(const string& source, uint64_t contentHash, const unsigned char* pixels, ImageData& image) {
+    if (image.Width <= 0 || image.Height <= 0) return false;
+    GLenum format = image.Alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+    // Size everything first so the storage never moves while it's filled
+    uint32_t mipLevels = 0;
+    size_t total = sizeof(KTXHeader) + KEY_VALUE_BYTES;
+    for (GLuint w = image.Width, h = image.Height; ; w = std::max(1u, w / 2), h = std::max(1u, h / 2)) {
+        total += sizeof(uint32_t) + levelSize(format, w, h);
+        mipLevels++;
+        if (w == 1 && h == 1) break;
+    }
+
+    vector<unsigned char> storage(total, 0);
+    KTXHeader header = {};
+    memcpy(header.Identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.Endianness = KTX_ENDIANNESS;
+    header.GLTypeSize = 1;
+    header.GLInternalFormat = format;
+    header.GLBaseInternalFormat = image.Alpha ? GL_RGBA : GL_RGB;
+    header.PixelWidth = image.Width;
+    header.PixelHeight = image.Height;
+    header.Faces = 1;
+    header.MipLevels = mipLevels;
+    header.KeyValueBytes = KEY_VALUE_BYTES;
+    memcpy(&storage[0], &header, sizeof(header));
+
+    size_t offset = sizeof(KTXHeader);
+    uint64_t key = cookKey(contentHash);
+    memcpy(&storage[offset], &KEY_VALUE_SIZE, sizeof(uint32_t));
+    memcpy(&storage[offset + sizeof(uint32_t)], SOURCE_KEY, sizeof(SOURCE_KEY));
+    memcpy(&storage[offset + sizeof(uint32_t) + sizeof(SOURCE_KEY)], &key, sizeof(key));
+    offset += KEY_VALUE_BYTES;
+
+    vector<unsigned char> current(pixels, pixels + (size_t)image.Width * image.Height * 4);
+    vector<unsigned char> next;
+    GLuint w = image.Width, h = image.Height;
+    for (uint32_t level = 0; level < mipLevels; level++) {
+        uint32_t size = (uint32_t)levelSize(format, w, h);
+        memcpy(&storage[offset], &size, sizeof(size));
+        offset += sizeof(size);
+
+        // Encode 4x4 blocks, repeating the edge pixels of levels that aren't a multiple of 4
+        unsigned char block[16 * 4];
+        for (GLuint by = 0; by < h; by += 4) {
+            for (GLuint bx = 0; bx < w; bx += 4) {
+                for (int i = 0; i < 16; i++) {
+                    GLuint x = std::min(bx + (i & 3), w - 1);
+                    GLuint y = std::min(by + (i >> 2), h - 1);
+                    memcpy(&block[i * 4], &current[((size_t)y * w + x) * 4], 4);
+                }
+                if (image.Alpha) {
+                    encodeAlphaBlock(block, &storage[offset]);
+                    offset += 8;
+                }
+                encodeColorBlock(block, &storage[offset]);
+                offset += 8;
+            }
+        }
+        if (level + 1 == mipLevels) break;
+
+        // 2x2 box filter down to the next level, clamping at odd edges
+        GLuint nw = std::max(1u, w / 2), nh = std::max(1u, h / 2);
+        next.resize((size_t)nw * nh * 4);
+        for (GLuint y = 0; y < nh; y++) {
+            GLuint y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+            for (GLuint x = 0; x < nw; x++) {
+                GLuint x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+                for (int c = 0; c < 4; c++) {
+                    int sum = current[((size_t)y0 * w + x0) * 4 + c] + current[((size_t)y0 * w + x1) * 4 + c]
+                            + current[((size_t)y1 * w + x0) * 4 + c] + current[((size_t)y1 * w + x1) * 4 + c];
+                    next[((size_t)y * nw + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        current.swap(next);
+        w = nw;
+        h = nh;
+    }
+
+    image.Storage.swap(storage);
+    if (!parseKTX(image.Storage.data(), image.Storage.size(), contentHash, image)) return false;
+
+    // Not being able to write the cache only costs the next launch a cook
+    Util::make_directory(Util::CACHE_DIRECTORY);
+    string path = CachePath(source);
+    string tempPath = path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    bool ok = file != nullptr && fwrite(image.Storage.data(), 1, image.Storage.size(), file) == image.Storage.size();
+    if (file != nullptr) ok = (fclose(file) == 0) && ok;
+    remove(path.c_str());
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Failed to write cooked texture %s\n", path.c_str());
+        remove(tempPath.c_str());
+    }
+    return true;
+}
+
+void TextureCooker::Decompress(const ImageData& image, vector<unsigned char>& storage, vector<TextureLevel>& levels) {
+    size_t total = 0;
+    for (auto& level : image.Levels) {
+        total += (size_t)level.Width * level.Height * 4;
+    }
+    storage.resize(total);
+    levels.clear();
+
+    bool alpha = image.Format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    size_t offset = 0;
+    unsigned char block[16 * 4];
+    for (auto& level : image.Levels) {
+        unsigned char* out = &storage[offset];
+        const unsigned char* in = level.Data;
+        for (GLuint by = 0; by < level.Height; by += 4) {
+            for (GLuint bx = 0; bx < level.Width; bx += 4) {
+                if (alpha) {
+                    decodeColorBlock(in + 8, block);
+                    decodeAlphaBlock(in, block);
+                    in += 16;
+                } else {
+                    decodeColorBlock(in, block);
+                    in += 8;
+                }
+                for (int i = 0; i < 16; i++) {
+                    GLuint x = bx + (i & 3), y = by + (i >> 2);
+                    if (x < level.Width && y < level.Height)
+                        memcpy(&out[((size_t)y * level.Width + x) * 4], &block[i * 4], 4);
+                }
+            }
+        }
+        TextureLevel expanded = { level.Width, level.Height, out, (GLsizei)(level.Width * level.Height * 4) };
+        levels.push_back(expanded);
+        offset += (size_t)level.Width * level.Height * 4;
+    }
+}
+
+void TextureCooker::encodeColorBlock(const unsigned char* block, unsigned char* out) {
+    // Endpoints from the block's bounding box, inset slightly since the extremes are rarely worth matching exactly
+    int minColor[3] = { 255, 255, 255 }, maxColor[3] = { 0, 0, 0 };
+    int mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            minColor[c] = std::min(minColor[c], (int)block[i * 4 + c]);
+            maxColor[c] = std::max(maxColor[c], (int)block[i * 4 + c]);
+            mean[c] += block[i * 4 + c];
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        int inset = (maxColor[c] - minColor[c]) / 16;
+        minColor[c] += inset;
+        maxColor[c] -= inset;
+        mean[c] /= 16;
+    }
+    // The box diagonal only follows the colours if red and blue vary the same way as green, flip them if not
+    int covRG = 0, covBG = 0;
+    for (int i = 0; i < 16; i++) {
+        int g = block[i * 4 + 1] - mean[1];
+        covRG += (block[i * 4] - mean[0]) * g;
+        covBG += (block[i * 4 + 2] - mean[2]) * g;
+    }
+    if (covRG < 0) std::swap(minColor[0], maxColor[0]);
+    if (covBG < 0) std::swap(minColor[2], maxColor[2]);
+
+    uint16_t color0 = packColor(maxColor[0], maxColor[1], maxColor[2]);
+    uint16_t color1 = packColor(minColor[0], minColor[1], minColor[2]);
+    // color0 > color1 selects the four colour mode
+    if (color0 < color1) std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        unpackColor(color0, palette[0]);
+        unpackColor(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = INT32_MAX;
+            for (int p = 0; p < 4; p++) {
+                int error = 0;
+                for (int c = 0; c < 3; c++) {
+                    int d = block[i * 4 + c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+        }
+    }
+
+    out[0] = color0 & 0xFF;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 0xFF;
+    out[3] = color1 >> 8;
+    for (int i = 0; i < 4; i++) {
+        out[4 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+}
+
+void TextureCooker::encodeAlphaBlock(const unsigned char* block, unsigned char* out) {
+    int minAlpha = 255, maxAlpha = 0;
+    for (int i = 0; i < 16; i++) {
+        minAlpha = std::min(minAlpha, (int)block[i * 4 + 3]);
+        maxAlpha = std::max(maxAlpha, (int)block[i * 4 + 3]);
+    }
+
+    // alpha0 > alpha1 selects eight interpolated values
+    uint64_t indices = 0;
+    if (maxAlpha != minAlpha) {
+        int palette[8];
+        palette[0] = maxAlpha;
+        palette[1] = minAlpha;
+        for (int p = 2; p < 8; p++) {
+            palette[p] = ((8 - p) * maxAlpha + (p - 1) * minAlpha) / 7;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = 256;
+            for (int p = 0; p < 8; p++) {
+                int error = abs(block[i * 4 + 3] - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (i * 3);
+        }
+    }
+
+    out[0] = (unsigned char)maxAlpha;
+    out[1] = (unsigned char)minAlpha;
+    for (int i = 0; i < 6; i++) {
+        out[2 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+}
+
+void TextureCooker::decodeColorBlock(const unsigned char* in, unsigned char* block) {
+    uint16_t color0 = in[0] | (in[1] << 8);
+    uint16_t color1 = in[2] | (in[3] << 8);
+    uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+
+    int palette[4][4];
+    unpackColor(color0, palette[0]);
+    unpackColor(color1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    for (int c = 0; c < 3; c++) {
+        if (color0 > color1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    // Three colour mode's last entry is transparent black
+    if (color0 <= color1) palette[3][3] = 0;
+
+    for (int i = 0; i < 16; i++) {
+        int index = (indices >> (i * 2)) & 3;
+        for (int c = 0; c < 4; c++) {
+            block[i * 4 + c] = (unsigned char)palette[index][c];
+        }
+    }
+}
+
+void TextureCooker::decodeAlphaBlock(const unsigned char* in, unsigned char* block) {
+    int alpha0 = in[0], alpha1 = in[1];
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; i++) {
+        indices |= (uint64_t)in[2 + i] << (i * 8);
+    }
+
+    int palette[8];
+    palette[0] = alpha0;
+    palette[1] = alpha1;
+    if (alpha0 > alpha1) {
+        for (int p = 2; p < 8; p++) {
+            palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+        }
+    } else {
+        for (int p = 2; p < 6; p++) {
+            palette[p] = ((6 - p) * alpha0 + (p - 1) * alpha1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    for (int i = 0; i < 16; i++) {
+        block[i * 4 + 3] = (unsigned char)palette[(indices >> (i * 3)) & 7];
+    }
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ResourceManager.h"
+
+using std::string;
+using std::vector;
+
+// Cooks decoded images into GPU ready mip chains. Opaque images become BC1
+// (DXT1) and images with alpha BC3 (DXT5), with every level down to 1x1
+// built by a 2x2 box filter. Cooked chains are stored as KTX 1.1 files in
+// Cache/, tagged with the source file's content hash so stale ones are
+// rebuilt. Drivers without S3TC get the chain expanded back to RGBA8.
+class TextureCooker
+{
+public:
+    static const uint32_t VERSION = 1;
+
+    static string CachePath(const string& source);
+
+    // Maps the cooked copy and points the image's levels into it. False if
+    // there isn't an up to date one.
+    static bool Load(const string& source, uint64_t contentHash, ImageData& image);
+    // Builds and encodes the mip chain from RGBA8 pixels into the image's
+    // Storage, then writes it to the cache
+    static bool Cook(const string& source, uint64_t contentHash, const unsigned char* pixels, ImageData& image);
+    // Expands a BC1/BC3 chain into RGBA8 levels held in storage
+    static void Decompress(const ImageData& image, vector<unsigned char>& storage, vector<TextureLevel>& levels);
+private:
+    TextureCooker() {}
+
+    // Reads a KTX file held in memory. The levels point into data.
+    static bool parseKTX(const unsigned char* data, size_t size, uint64_t contentHash, ImageData& image);
+
+    static void encodeColorBlock(const unsigned char* block, unsigned char* out);
+    static void encodeAlphaBlock(const unsigned char* block, unsigned char* out);
+    static void decodeColorBlock(const unsigned char* in, unsigned char* block);
+    static void decodeAlphaBlock(const unsigned char* in, unsigned char* block);
+};
\ No newline at end of file
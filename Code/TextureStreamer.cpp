@@ -0,0 +1,164 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Profiler.h"
+
+// Bytes in one row of the level, a row of 4x4 blocks for compressed formats
+static size_t rowBytes(GLenum format, GLuint width) {
+	if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) return ((width + 3) / 4) * 16;
+	if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) return ((width + 3) / 4) * 8;
+	return width * 4;
+}
+
+static GLuint rowHeight(GLenum format) {
+	return Texture2D::IsCompressed(format) ? 4 : 1;
+}
+
+void TextureStreamer::Init(GLuint buffers, GLsizeiptr bufferSize) {
+	if (!slots.empty()) return;
+	slots.resize(buffers);
+	slotSize = bufferSize;
+	for (auto& slot : slots) {
+		glGenBuffers(1, &slot.Buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.Buffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::Enqueue(const Texture2D& texture, GLenum format, const TextureLevel* levels, GLuint levelCount, std::shared_ptr<void> owner) {
+	if (slots.empty()) Init();
+	Job job;
+	job.Texture = texture.ID;
+	job.Format = format;
+	job.Levels.assign(levels, levels + levelCount);
+	job.Owner = owner;
+	job.Level = levelCount - 1;
+	job.Row = 0;
+	jobs.push_back(job);
+}
+
+void TextureStreamer::Cancel(GLuint texture) {
+	jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [texture](const Job& job) { return job.Texture == texture; }), jobs.end());
+}
+
+void TextureStreamer::Process(size_t byteBudget) {
+	PROFILE_ZONE("Texture streaming");
+	FrameStats = {};
+	size_t sent = 0;
+	while (!jobs.empty()) {
+		if (sent > 0 && sent >= byteBudget) break;
+		size_t bytes = fillSlot(byteBudget - sent);
+		if (bytes == 0) break;
+		sent += bytes;
+	}
+	FrameStats.Streaming = (GLuint)jobs.size();
+}
+
+size_t TextureStreamer::nextJob() const {
+	size_t best = 0;
+	for (size_t i = 1; i < jobs.size(); i++) {
+		if (jobs[i].Levels[jobs[i].Level].Size < jobs[best].Levels[jobs[best].Level].Size)
+			best = i;
+	}
+	return best;
+}
+
+size_t TextureStreamer::fillSlot(size_t byteBudget) {
+	Slot& slot = slots[nextSlot];
+	if (slot.Fence != 0) {
+		// Never wait, the copies can pick up again next frame
+		if (glClientWaitSync(slot.Fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			FrameStats.FenceWaits++;
+			return 0;
+		}
+		glDeleteSync(slot.Fence);
+		slot.Fence = 0;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.Buffer);
+	// The fence says the GPU is done with the old contents, no need for the driver to sync too
+	auto mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotSize,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped == nullptr) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return 0;
+	}
+
+	// Pack slices in until the buffer or the budget runs out
+	copies.clear();
+	size_t offset = 0;
+	size_t limit = std::min((size_t)slotSize, byteBudget);
+	while (!jobs.empty()) {
+		Job& job = jobs[nextJob()];
+		const TextureLevel& level = job.Levels[job.Level];
+		size_t stride = rowBytes(job.Format, level.Width);
+		GLuint height = rowHeight(job.Format);
+		GLuint rows = (level.Height + height - 1) / height;
+
+		size_t space = ((size_t)slotSize - offset) / stride;
+		size_t allowed = (limit > offset ? limit - offset : 0) / stride;
+		// The first slice goes in even when it's over budget, so streaming always moves
+		if (offset == 0) allowed = std::max<size_t>(allowed, 1);
+		GLuint count = (GLuint)std::min(std::min(space, allowed), (size_t)(rows - job.Row));
+		if (count == 0) break;
+
+		Copy copy;
+		copy.Texture = job.Texture;
+		copy.Format = job.Format;
+		copy.Level = job.Level;
+		copy.Y = job.Row * height;
+		copy.Width = level.Width;
+		copy.Height = std::min(count * height, level.Height - copy.Y);
+		copy.Offset = offset;
+		copy.Bytes = count * stride;
+		memcpy(mapped + offset, level.Data + job.Row * stride, copy.Bytes);
+		offset += copy.Bytes;
+
+		job.Row += count;
+		copy.LevelDone = job.Row == rows;
+		copies.push_back(copy);
+		if (copy.LevelDone) {
+			job.Level--;
+			job.Row = 0;
+			if (job.Level < 0) {
+				jobs.erase(jobs.begin() + (&job - &jobs[0]));
+			}
+		}
+		if (offset >= limit) break;
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	for (auto& copy : copies) {
+		glBindTexture(GL_TEXTURE_2D, copy.Texture);
+		if (Texture2D::IsCompressed(copy.Format))
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, copy.Level, 0, copy.Y, copy.Width, copy.Height, copy.Format, (GLsizei)copy.Bytes, (void*)copy.Offset);
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, copy.Level, 0, copy.Y, copy.Width, copy.Height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)copy.Offset);
+		// Let sampling reach the level now that it is complete
+		if (copy.LevelDone) {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, copy.Level);
+			FrameStats.LevelsCompleted++;
+		}
+		FrameStats.Uploads++;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	slot.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	nextSlot = (nextSlot + 1) % slots.size();
+	FrameStats.BytesUploaded += (GLuint)offset;
+	return offset;
+}
+
+void TextureStreamer::Clear() {
+	for (auto& slot : slots) {
+		if (slot.Fence != 0) glDeleteSync(slot.Fence);
+		glDeleteBuffers(1, &slot.Buffer);
+	}
+	slots.clear();
+	jobs.clear();
+	nextSlot = 0;
+}
\ No newline at end of file
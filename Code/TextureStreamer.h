@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "Texture.h"
+
+// Streams texture mip chains to the GPU through a ring of pixel buffer
+// objects. Textures are allocated up front and their levels are copied in
+// smallest first, a slice of rows at a time, under a per-frame byte budget.
+// GL_TEXTURE_BASE_LEVEL follows the uploads, so a texture samples from
+// whichever mips have arrived. Fences recycle the buffers without stalling,
+// a buffer the GPU hasn't finished with just ends the frame's streaming.
+class TextureStreamer
+{
+public:
+	struct Stats {
+		GLuint Uploads; // Sub-image copies issued
+		GLuint LevelsCompleted;
+		GLuint BytesUploaded;
+		GLuint FenceWaits; // Times a busy buffer ended the frame early
+		GLuint Streaming; // Textures still waiting on levels
+	};
+	Stats FrameStats = {};
+
+	// Creates the buffers on first use. Each buffer must hold at least one row of the widest level.
+	void Init(GLuint buffers = 4, GLsizeiptr bufferSize = 4 * 1024 * 1024);
+	// Queues a texture already allocated with Texture2D::Allocate. The levels must stay
+	// valid until it finishes, owner is held until then to guarantee that.
+	void Enqueue(const Texture2D& texture, GLenum format, const TextureLevel* levels, GLuint levelCount, std::shared_ptr<void> owner);
+	// Stops streaming a texture that is about to be deleted
+	void Cancel(GLuint texture);
+	// Uploads up to byteBudget bytes, always at least one slice
+	void Process(size_t byteBudget);
+	bool Busy() const { return !jobs.empty(); }
+	// Deletes the buffers. Needs the GL context.
+	void Clear();
+private:
+	struct Job {
+		GLuint Texture;
+		GLenum Format;
+		std::vector<TextureLevel> Levels;
+		std::shared_ptr<void> Owner;
+		GLint Level; // Level being uploaded, counts down to 0
+		GLuint Row; // Next row (of blocks, for compressed formats) in that level
+	};
+	struct Slot {
+		GLuint Buffer = 0;
+		GLsync Fence = 0;
+	};
+	// A slice written into the mapped buffer, issued once it is unmapped
+	struct Copy {
+		GLuint Texture;
+		GLenum Format;
+		GLint Level;
+		GLint Y;
+		GLsizei Width, Height;
+		size_t Offset, Bytes;
+		bool LevelDone;
+	};
+
+	std::vector<Slot> slots;
+	GLsizeiptr slotSize = 0;
+	GLuint nextSlot = 0;
+	std::vector<Job> jobs;
+	std::vector<Copy> copies;
+
+	// Index of the job whose next level is smallest
+	size_t nextJob() const;
+	// Fills the next free buffer with slices and issues them. Returns the bytes
+	// sent, 0 if the buffer is still in use by the GPU.
+	size_t fillSlot(size_t byteBudget);
+};
\ No newline at end of file
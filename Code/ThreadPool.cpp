@@ -0,0 +1,93 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "Profiler.h"
+
+ThreadPool::ThreadPool(unsigned int threads) {
+    if (threads == 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 1;
+    }
+    for (unsigned int i=0; i<threads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::Enqueue(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, std::function<void(size_t)> body) {
+    if (count == 0) return;
+    struct Loop {
+        std::function<void(size_t)> Body;
+        size_t Count;
+        std::atomic<size_t> Next;
+        int Active = 0;
+        std::mutex Mutex;
+        std::condition_variable Done;
+
+        void Run() {
+            for (size_t i = Next++; i < Count; i = Next++) Body(i);
+        }
+    };
+    auto loop = std::make_shared<Loop>();
+    loop->Body = std::move(body);
+    loop->Count = count;
+    loop->Next = 0;
+
+    // Helpers that only get to run after the caller has taken every index find nothing left
+    size_t helpers = std::min(count - 1, workers.size());
+    for (size_t i=0; i<helpers; i++) {
+        Enqueue([loop] {
+            {
+                std::lock_guard<std::mutex> lock(loop->Mutex);
+                loop->Active++;
+            }
+            loop->Run();
+            {
+                std::lock_guard<std::mutex> lock(loop->Mutex);
+                loop->Active--;
+            }
+            loop->Done.notify_all();
+        });
+    }
+    loop->Run();
+    std::unique_lock<std::mutex> lock(loop->Mutex);
+    loop->Done.wait(lock, [&] { return loop->Active == 0; });
+}
+
+void ThreadPool::workerLoop() {
+    static std::atomic<int> started(0);
+    Profiler::SetThreadName("Pool worker " + std::to_string(++started));
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            // Finish whatever is queued before shutting down
+            if (jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
\ No newline at end of file
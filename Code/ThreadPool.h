@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling jobs from a shared queue. Meant for
+// long running, blocking work like file parsing and image decoding.
+class ThreadPool
+{
+public:
+    // 0 threads means one per core, leaving one for the main thread
+    ThreadPool(unsigned int threads = 0);
+    ~ThreadPool();
+
+    void Enqueue(std::function<void()> job);
+    // Runs body(0) to body(count - 1) across the pool and returns once they are
+    // all done. The calling thread joins in, so this is safe to call from a job.
+    void ParallelFor(size_t count, std::function<void(size_t)> body);
+    unsigned int Size() const { return (unsigned int)workers.size(); }
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop();
+};
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "TransformSystem.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define TRANSFORM_SSE
+#include <xmmintrin.h>
+#endif
+
+// Transforms per job, a multiple of four so batches never straddle jobs
+const size_t TRANSFORM_GRAIN = 512;
+
+TransformId TransformSystem::Create(glm::vec3 position, glm::vec3 rotation, glm::vec3 size) {
+    TransformId id;
+    if (!freeSlots.empty()) {
+        id = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        id = (TransformId)positions.size();
+        positions.emplace_back();
+        rotations.emplace_back();
+        sizes.emplace_back();
+        world.emplace_back(1.0f);
+        normal.emplace_back(1.0f);
+        dirty.push_back(0);
+    }
+    positions[id] = position;
+    rotations[id] = rotation;
+    sizes[id] = size;
+    dirty[id] = 1;
+    return id;
+}
+
+void TransformSystem::Destroy(TransformId id) {
+    dirty[id] = 0;
+    freeSlots.push_back(id);
+}
+
+void TransformSystem::gatherDirty() {
+    pending.clear();
+    for (TransformId id = 0; id < (TransformId)dirty.size(); id++) {
+        if (dirty[id]) {
+            dirty[id] = 0;
+            pending.push_back(id);
+        }
+    }
+    FrameStats.Transforms = (GLuint)(positions.size() - freeSlots.size());
+    FrameStats.Updated = (GLuint)pending.size();
+}
+
+void TransformSystem::Update() {
+    gatherDirty();
+    for (size_t i = 0; i < pending.size(); i += 4) {
+        buildBatch(&pending[i], std::min<size_t>(4, pending.size() - i));
+    }
+}
+
+void TransformSystem::Update(JobSystem& jobs) {
+    gatherDirty();
+    jobs.ParallelFor(pending.size(), TRANSFORM_GRAIN, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i += 4) {
+            buildBatch(&pending[i], std::min<size_t>(4, end - i));
+        }
+    });
+}
+
+#ifdef TRANSFORM_SSE
+void TransformSystem::buildBatch(const TransformId* ids, size_t count) {
+    // Lane i of each register holds ids[i], short batches repeat the last one
+    alignas(16) float lanes[9][4];
+    for (size_t lane = 0; lane < 4; lane++) {
+        TransformId id = ids[std::min(lane, count - 1)];
+        const glm::vec3& r = rotations[id];
+        for (int axis = 0; axis < 3; axis++) {
+            lanes[axis][lane] = sinf(r[axis] * 0.5f);
+            lanes[3 + axis][lane] = cosf(r[axis] * 0.5f);
+            lanes[6 + axis][lane] = sizes[id][axis];
+        }
+    }
+    __m128 sx = _mm_load_ps(lanes[0]), sy = _mm_load_ps(lanes[1]), sz = _mm_load_ps(lanes[2]);
+    __m128 cx = _mm_load_ps(lanes[3]), cy = _mm_load_ps(lanes[4]), cz = _mm_load_ps(lanes[5]);
+
+    // Quaternion from euler angles, as glm::quat(vec3)
+    __m128 cycz = _mm_mul_ps(cy, cz), sysz = _mm_mul_ps(sy, sz);
+    __m128 sycz = _mm_mul_ps(sy, cz), cysz = _mm_mul_ps(cy, sz);
+    __m128 qw = _mm_add_ps(_mm_mul_ps(cx, cycz), _mm_mul_ps(sx, sysz));
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sx, cycz), _mm_mul_ps(cx, sysz));
+    __m128 qy = _mm_add_ps(_mm_mul_ps(cx, sycz), _mm_mul_ps(sx, cysz));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(cx, cysz), _mm_mul_ps(sx, sycz));
+
+    // Rotation matrix, rot[column][row]
+    const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+    __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+    __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+    __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+    __m128 rot[3][3];
+    rot[0][0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+    rot[0][1] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+    rot[0][2] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+    rot[1][0] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+    rot[1][1] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+    rot[1][2] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+    rot[2][0] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+    rot[2][1] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+    rot[2][2] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+    // scale * translate * rotate leaves each row of the rotation scaled by that
+    // axis' size, so the inverse transpose of it is each row divided instead
+    __m128 scale[3] = { _mm_load_ps(lanes[6]), _mm_load_ps(lanes[7]), _mm_load_ps(lanes[8]) };
+    __m128 inverseScale[3] = { _mm_div_ps(one, scale[0]), _mm_div_ps(one, scale[1]), _mm_div_ps(one, scale[2]) };
+    __m128 worldColumns[4][4], normalColumns[3][4];
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            worldColumns[column][row] = _mm_mul_ps(rot[column][row], scale[row]);
+            normalColumns[column][row] = _mm_mul_ps(rot[column][row], inverseScale[row]);
+        }
+        worldColumns[column][3] = _mm_setzero_ps();
+        normalColumns[column][3] = _mm_setzero_ps();
+        // Lane i of each row becomes row i, the columns of transform i
+        _MM_TRANSPOSE4_PS(worldColumns[column][0], worldColumns[column][1], worldColumns[column][2], worldColumns[column][3]);
+        _MM_TRANSPOSE4_PS(normalColumns[column][0], normalColumns[column][1], normalColumns[column][2], normalColumns[column][3]);
+    }
+
+    for (size_t lane = 0; lane < count; lane++) {
+        TransformId id = ids[lane];
+        float* out = &world[id][0][0];
+        for (int column = 0; column < 3; column++) {
+            _mm_storeu_ps(out + column * 4, worldColumns[column][lane]);
+        }
+        const glm::vec3& position = positions[id];
+        const glm::vec3& size = sizes[id];
+        world[id][3] = glm::vec4(position * size, 1.0f);
+
+        // mat3 columns are packed, go through the stack rather than overrun the last one
+        alignas(16) float normalOut[12];
+        for (int column = 0; column < 3; column++) {
+            _mm_store_ps(normalOut + column * 4, normalColumns[column][lane]);
+        }
+        float* normalDest = &normal[id][0][0];
+        for (int column = 0; column < 3; column++) {
+            memcpy(normalDest + column * 3, normalOut + column * 4, sizeof(float) * 3);
+        }
+    }
+}
+#else
+void TransformSystem::buildBatch(const TransformId* ids, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        TransformId id = ids[i];
+        glm::mat4 model = glm::scale(glm::mat4(1.0f), sizes[id]);
+        model = glm::translate(model, positions[id]);
+        model *= glm::toMat4(glm::quat(rotations[id]));
+        world[id] = model;
+        normal[id] = glm::mat3(glm::transpose(glm::inverse(model)));
+    }
+}
+#endif
\ No newline at end of file
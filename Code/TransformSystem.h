@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+class JobSystem;
+
+typedef GLuint TransformId;
+
+// Every object's position, rotation and size kept as separate arrays, along
+// with the world and normal matrices built from them. Setting a field marks
+// the transform dirty and Update rebuilds only the dirty ones, four at a time
+// with SSE, so static objects cost nothing per frame.
+//
+// World matrices are scale * translate * rotate, rotation being XYZ euler
+// angles in radians. Normal matrices are the inverse transpose of the upper
+// 3x3, ready to upload as is.
+//
+// Setters for different transforms can be called from several threads at
+// once, but not during Update.
+class TransformSystem
+{
+public:
+    struct Stats {
+        GLuint Transforms; // Live transforms
+        GLuint Updated;    // Rebuilt by the last Update
+    };
+    Stats FrameStats = {};
+
+    TransformId Create(glm::vec3 position = glm::vec3(0), glm::vec3 rotation = glm::vec3(0), glm::vec3 size = glm::vec3(1));
+    void Destroy(TransformId id);
+
+    void SetPosition(TransformId id, glm::vec3 position) { positions[id] = position; dirty[id] = 1; }
+    void SetRotation(TransformId id, glm::vec3 rotation) { rotations[id] = rotation; dirty[id] = 1; }
+    void SetSize(TransformId id, glm::vec3 size) { sizes[id] = size; dirty[id] = 1; }
+    const glm::vec3& GetPosition(TransformId id) const { return positions[id]; }
+    const glm::vec3& GetRotation(TransformId id) const { return rotations[id]; }
+    const glm::vec3& GetSize(TransformId id) const { return sizes[id]; }
+
+    // Valid after the Update following the last change
+    const glm::mat4& World(TransformId id) const { return world[id]; }
+    const glm::mat3& Normal(TransformId id) const { return normal[id]; }
+
+    // Rebuilds the matrices of every transform changed since the last update
+    void Update();
+    // Same as Update, with the rebuild split across the job system
+    void Update(JobSystem& jobs);
+private:
+    vector<glm::vec3> positions;
+    vector<glm::vec3> rotations;
+    vector<glm::vec3> sizes;
+    vector<glm::mat4> world;
+    vector<glm::mat3> normal;
+    vector<uint8_t> dirty;
+    vector<TransformId> freeSlots;
+    // Dirty transforms gathered by the current update
+    vector<TransformId> pending;
+
+    void gatherDirty();
+    // Rebuilds the matrices for count (at most 4) transforms
+    void buildBatch(const TransformId* ids, size_t count);
+};
\ No newline at end of file
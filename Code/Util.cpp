@@ -1,36 +1,96 @@
-#include "Util.h"
-
-#include <random>
-#include <chrono>
-
-namespace Util {
-
-    std::minstd_rand engine;
-
-    void init_random() {
-        auto time = std::chrono::high_resolution_clock().now();
-
-        // Cast the time_point directly to an int to use as the random seed
-        unsigned int seed = *(unsigned int*)(void*)&time;
-
-        printf("Seed: %u\n", seed);
-
-        engine = std::minstd_rand();
-        engine.seed(seed);
-    }
-
-    unsigned int random() {
-        return engine();
-    }
-
-    float random_float(float min, float max) {
-        auto rand = (float)random();
-        return min + (rand / (engine.max()/(max-min)));
-    }
-
-    float poly_interpolation(float value, int index) {
-        if (value < 0) value = 0;
-        if (value > 1) value = 1;
-        return abs(pow(value, index));
-    }
+#include "Util.h"
+
+#include <random>
+#include <chrono>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace Util {
+
+    std::minstd_rand engine;
+
+    void init_random() {
+        auto time = std::chrono::high_resolution_clock().now();
+
+        // Cast the time_point directly to an int to use as the random seed
+        unsigned int seed = *(unsigned int*)(void*)&time;
+
+        printf("Seed: %u\n", seed);
+
+        engine = std::minstd_rand();
+        engine.seed(seed);
+    }
+
+    unsigned int random() {
+        return engine();
+    }
+
+    float random_float(float min, float max) {
+        auto rand = (float)random();
+        return min + (rand / (engine.max()/(max-min)));
+    }
+
+    uint64_t hash_bytes(const void* data, size_t length, uint64_t seed) {
+        uint64_t hash = seed;
+        auto bytes = (const unsigned char*)data;
+        for (size_t i=0; i<length; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    bool make_directory(const std::string& path) {
+#ifdef _WIN32
+        return CreateDirectoryA(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+        struct stat info;
+        return mkdir(path.c_str(), 0755) == 0 || (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode));
+#endif
+    }
+
+    std::vector<std::string> list_files(const std::string& directory) {
+        std::vector<std::string> files;
+#ifdef _WIN32
+        WIN32_FIND_DATAA entry;
+        HANDLE find = FindFirstFileA((directory + "/*").c_str(), &entry);
+        if (find == INVALID_HANDLE_VALUE) return files;
+        do {
+            if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                files.push_back(entry.cFileName);
+        } while (FindNextFileA(find, &entry));
+        FindClose(find);
+#else
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr) return files;
+        while (dirent* entry = readdir(dir)) {
+            struct stat info;
+            std::string path = directory + "/" + entry->d_name;
+            if (stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+                files.push_back(entry->d_name);
+        }
+        closedir(dir);
+#endif
+        return files;
+    }
+
+    std::string cache_path(const std::string& source, const char* extension) {
+        std::string name = source;
+        for (auto& c : name) {
+            if (c == '/' || c == '\\' || c == ':') c = '_';
+        }
+        return CACHE_DIRECTORY + "/" + name + extension;
+    }
+
+    float poly_interpolation(float value, int index) {
+        if (value < 0) value = 0;
+        if (value > 1) value = 1;
+        return abs(pow(value, index));
+    }
 }
\ No newline at end of file
@@ -1,10 +1,26 @@
-#pragma once
-#include <random>
-
-namespace Util {
-
-    void init_random();
-    unsigned int random();
-    float random_float(float min, float max);
-
+#pragma once
+#include <random>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Util {
+
+    void init_random();
+    unsigned int random();
+    float random_float(float min, float max);
+
+    // 64-bit FNV-1a hash of a block of memory. Pass a previous result as
+    // the seed to hash several blocks as one.
+    const uint64_t HASH_SEED = 14695981039346656037ULL;
+    uint64_t hash_bytes(const void* data, size_t length, uint64_t seed = HASH_SEED);
+
+    // Creates a directory if it isn't there already. Parent directories must exist.
+    bool make_directory(const std::string& path);
+    // Names of the regular files in a directory, without the directory prefix
+    std::vector<std::string> list_files(const std::string& directory);
+    // Where the cooked copy of a source asset lives, Cache/ plus the flattened source path
+    const std::string CACHE_DIRECTORY = "Cache";
+    std::string cache_path(const std::string& source, const char* extension);
+
 };
\ No newline at end of file
@@ -1,109 +1,277 @@
-#include "Game.h"
-#include "Code\\ResourceManager.h"
-#include "Code\\Model.h"
-
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
-#include <glm/gtx/string_cast.hpp>
-#include <glm/gtx/quaternion.hpp>
-
-#include <iostream>
-
-const glm::vec3 FORWARD = glm::vec3(0.0f, 0.0f, -1.0f);
-const glm::vec3 UP = glm::vec3(0.0f, 1.0f, 0.0f);
-const glm::vec3 RIGHT = glm::vec3(1.0f, 0.0f, 0.0f);
-const float MOUSE_SENS = 45.0f;
-const float MOVE_SPEED = 10.0f;
-
-vector<Model*> objects;
-
-Game::Game(GLuint width, GLuint height)
-	: Width(width), Height(height)
-{
-	CameraPos = glm::vec3(0, 0, 5.0f);
-	CameraRot = glm::vec3(0, 0, 0);
-}
-
-Game::~Game()
-{
-	for (auto object : objects) {
-		delete object;
-	}
-}
-
-void Game::Init()
-{
-	ResourceManager::LoadShader("Shaders/baseproj.vert", "Shaders/baseproj.frag", nullptr, "baseproj");
-	ResourceManager::LoadShader("Shaders/material.vert", "Shaders/material.frag", nullptr, "material");
-	ResourceManager::LoadModelData("Models/ball_mars.obj", "ball");
-	ResourceManager::LoadModelData("Models/cube-light.obj", "cube-light");
-	ResourceManager::LoadModelData("Models/radio.obj", "radio");
-	
-	CurrentProjection = glm::perspective(glm::radians(60.0f), float(Width) / Height, 0.1f, 100.0f);
-
-	objects.push_back(new Model("ball", glm::vec3(0,0,0)));
-	objects.push_back(new Model("cube-light", glm::vec3(5,0,0)));
-	objects.push_back(new Model("radio", glm::vec3(10,0,0)));
-}
-
-void Game::Update(GLfloat dt)
-{
-	this->dt = dt;
-
-	//CalculateLighting();
-	CalculateCamera();
-
-	for (auto object : objects) {
-		object->Update(dt);
-	}
-}
-
-void Game::CalculateCamera() {
-	CameraRot += glm::vec3(Mouse.y, -Mouse.x, 0) * dt * MOUSE_SENS;
-	if (CameraRot.x > 89.0f)  CameraRot.x = 89.0f;
-	if (CameraRot.x < -89.0f) CameraRot.x = -89.0f;
-
-	glm::vec3 direction = FORWARD;
-	glm::quat rot = glm::quat(glm::radians(CameraRot));
-	direction = glm::rotate(rot, direction);
-	direction = glm::normalize(direction);
-
-	// Rotation without X axis, for use with movement
-	glm::quat rotNoX = glm::quat(glm::radians(glm::vec3(
-		0,
-		CameraRot.y,
-		CameraRot.z
-	)));
-
-	glm::vec3 moveVector(0,0,0);
-	if (Keys[GLFW_KEY_W])
-		moveVector += FORWARD;
-	if (Keys[GLFW_KEY_A])
-		moveVector -= RIGHT;
-	if (Keys[GLFW_KEY_S])
-		moveVector -= FORWARD;
-	if (Keys[GLFW_KEY_D])
-		moveVector += RIGHT;
-	if (Keys[GLFW_KEY_SPACE])
-		moveVector += UP;
-	if (Keys[GLFW_KEY_LEFT_CONTROL])
-		moveVector -= UP;
-	moveVector *= dt * MOVE_SPEED;
-	CameraPos += glm::rotate(rotNoX, moveVector);
-
-	CurrentView = glm::mat4(1.0);
-	CurrentView = glm::lookAt(CameraPos, CameraPos + direction, UP);
-}
-
-void Game::Draw()
-{
-	for (auto object : objects) {
-		object->Draw(CurrentProjection, CurrentView, CameraPos);
-	}
-}
-
-void Game::ResizeEvent(GLfloat width, GLfloat height)
-{
-	Width = width;
-	Height = height;
+#include "Game.h"
+#include "Code\\ResourceManager.h"
+#include "Code\\Model.h"
+#include "Code\\Shader.h"
+#include "Code\\Material.h"
+#include "Code\\ProgramCache.h"
+#include "Code\\Profiler.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/string_cast.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <iostream>
+
+const glm::vec3 FORWARD = glm::vec3(0.0f, 0.0f, -1.0f);
+const glm::vec3 UP = glm::vec3(0.0f, 1.0f, 0.0f);
+const glm::vec3 RIGHT = glm::vec3(1.0f, 0.0f, 0.0f);
+const float MOUSE_SENS = 45.0f;
+const float MOVE_SPEED = 10.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+// Scene ambient light, strength in alpha
+const glm::vec4 AMBIENT_COLOR = glm::vec4(1.0f, 1.0f, 1.0f, 0.2f);
+// Bytes of mesh data sent to the GL per frame by async loads
+const size_t UPLOAD_BUDGET = 32 * 1024 * 1024;
+// Bytes of texture data streamed per frame
+const size_t TEXTURE_STREAM_BUDGET = 8 * 1024 * 1024;
+// Objects per job when updating and transforming
+const size_t OBJECT_GRAIN = 256;
+// Frames recorded by a profiler capture (F4)
+const int CAPTURE_FRAMES = 300;
+const char* CAPTURE_PATH = "profile.json";
+
+vector<Model*> objects;
+
+Game::Game(GLuint width, GLuint height)
+	: Width(width), Height(height)
+{
+	CameraPos = glm::vec3(0, 0, 5.0f);
+	CameraRot = glm::vec3(0, 0, 0);
+	// Statics go in reverse order of construction, creating the transforms before we
+	// finish constructing keeps them alive for any model our destructor deletes
+	Model::Transforms();
+}
+
+Game::~Game()
+{
+	Shutdown();
+}
+
+void Game::Shutdown()
+{
+	for (auto object : objects) {
+		delete object;
+	}
+	objects.clear();
+	cullCandidates.clear();
+	visibleObjects.clear();
+	Jobs.reset();
+}
+
+void Game::Init()
+{
+	Jobs.reset(new JobSystem());
+	// These register block bindings and sampler units, so must come before any shader is loaded
+	Lighting.Init();
+	Lights.Init();
+	Material::RegisterSamplerUnits();
+
+	ResourceManager::LoadShader("Shaders/baseproj.vert", "Shaders/baseproj.frag", nullptr, "baseproj");
+	// Variants for each material's maps, and for instancing. All of them are issued
+	// now so the driver builds them alongside the model loads, meshes draw with the
+	// plain variant until theirs is ready.
+	ResourceManager::LoadShader("Shaders/material.vert", "Shaders/material.frag", nullptr, "material",
+		SHADER_DIFFUSE_MAP | SHADER_SPECULAR_MAP | SHADER_INSTANCED);
+	ResourceManager::PrepareShaderVariants("material");
+	// Models stream in over the first few frames, objects start drawing as theirs arrive
+	ResourceManager::LoadModelDataAsync("Models/ball_mars.obj", "ball");
+	ResourceManager::LoadModelDataAsync("Models/cube-light.obj", "cube-light");
+	ResourceManager::LoadModelDataAsync("Models/radio.obj", "radio");
+	
+	CurrentProjection = glm::perspective(glm::radians(60.0f), float(Width) / Height, NEAR_PLANE, FAR_PLANE);
+
+	objects.push_back(new Model("ball", glm::vec3(0,0,0)));
+	objects.push_back(new Model("cube-light", glm::vec3(5,0,0)));
+	objects.push_back(new Model("radio", glm::vec3(10,0,0)));
+}
+
+void Game::Update(GLfloat dt)
+{
+	this->dt = dt;
+
+	ResourceManager::ProcessUploads(UPLOAD_BUDGET);
+	ResourceManager::ProcessShaderBuilds();
+	ResourceManager::Streamer.Process(TEXTURE_STREAM_BUDGET);
+
+	//CalculateLighting();
+	CalculateCamera();
+
+	{
+		PROFILE_ZONE("Object updates");
+		Jobs->ParallelFor(objects.size(), OBJECT_GRAIN, [&](size_t begin, size_t end) {
+			for (size_t i=begin; i<end; i++) {
+				objects[i]->Update(dt);
+			}
+		});
+	}
+
+	// Counters still hold the previous frame at this point
+	if (Keys[GLFW_KEY_F3] && !statsKeyHeld)
+		PrintStats();
+	statsKeyHeld = Keys[GLFW_KEY_F3];
+	if (Keys[GLFW_KEY_F4] && !captureKeyHeld && !Profiler::Capturing())
+		Profiler::StartCapture(CAPTURE_FRAMES, CAPTURE_PATH);
+	captureKeyHeld = Keys[GLFW_KEY_F4];
+}
+
+void Game::PrintStats()
+{
+	auto frames = Pacer.GetStats();
+	printf("[STATS] Frames - target: %.0f fps%s, mean: %.2f ms, p99: %.2f ms, jitter: %.2f ms, waiting: %.2f ms, sleep granularity: %.2f ms\n",
+		Pacer.TargetRate(), Pacer.Vsync() ? " (vsync)" : "", frames.MeanMs, frames.P99Ms, frames.JitterMs, frames.WaitMs, frames.SleepGranularityMs);
+	auto& programs = ProgramCache::LoadStats;
+	printf("[STATS] Programs - compiled: %u (%.1f ms blocking, parallel: %s), from binary cache: %u (%.1f ms), binaries rejected: %u\n",
+		programs.Compiled, programs.CompileMs, Shader::ParallelCompileSupported() ? "yes" : "no", programs.Loaded, programs.LoadMs, programs.Rejected);
+	printf("[STATS] Uniforms - driver lookups: %u, table lookups: %u, sets: %u\n",
+		Shader::FrameStats.DriverLookups, Shader::FrameStats.TableLookups, Shader::FrameStats.UniformSets);
+	printf("[STATS] Lighting - sets submitted: %u, distinct: %u, bytes uploaded: %u, range binds: %u\n",
+		Lighting.FrameStats.Submitted, Lighting.FrameStats.Distinct, Lighting.FrameStats.BytesUploaded, Lighting.FrameStats.RangeBinds);
+	printf("[STATS] Transforms - live: %u, rebuilt: %u\n",
+		Model::Transforms().FrameStats.Transforms, Model::Transforms().FrameStats.Updated);
+	auto& lights = Lights.FrameStats;
+	printf("[STATS] Lights - lights: %u, cluster assignments: %u, most in one cluster: %u, dropped: %u, bytes uploaded: %u\n",
+		lights.Lights, lights.Assignments, lights.MaxPerCluster, lights.Dropped, lights.BytesUploaded);
+	auto& culling = Culling.FrameStats;
+	printf("[STATS] Culling - objects tested: %u, visible: %u, culled: %u, meshes tested: %u, meshes culled: %u\n",
+		culling.Tested, culling.Visible, culling.Culled, culling.MeshesTested, culling.MeshesCulled);
+	auto& textures = ResourceManager::TextureStats;
+	printf("[STATS] Textures - cache hits: %u, misses: %u, bytes saved: %zu, bytes resident: %zu\n",
+		textures.Hits, textures.Misses, textures.BytesSaved, textures.BytesResident);
+	auto& streaming = ResourceManager::Streamer.FrameStats;
+	printf("[STATS] Streaming - uploads: %u, levels completed: %u, bytes: %u, fence waits: %u, textures streaming: %u\n",
+		streaming.Uploads, streaming.LevelsCompleted, streaming.BytesUploaded, streaming.FenceWaits, streaming.Streaming);
+	for (GeometryArena* arena : { &Mesh::Arena, &Mesh::PackedArena }) {
+		auto geometry = arena->GetStats();
+		printf("[STATS] Geometry (%s) - allocations: %u, vertex bytes: %zu/%zu, index bytes: %zu/%zu, free blocks: %u, fragmentation: %.0f%%, compactions: %u\n",
+			arena == &Mesh::Arena ? "float" : "packed",
+			geometry.Allocations, geometry.VertexBytesUsed, geometry.VertexBytesCapacity, geometry.IndexBytesUsed, geometry.IndexBytesCapacity,
+			geometry.FreeBlocks, geometry.Fragmentation * 100, geometry.Compactions);
+	}
+	auto& queue = Queue.FrameStats;
+	printf("[STATS] Queue - packets: %u, draw calls: %u, instanced draws: %u (%u instances), program changes: %u, material changes: %u, texture binds: %u, VAO changes: %u, lighting changes: %u, transform uploads: %u\n",
+		queue.Packets, queue.DrawCalls, queue.InstancedDraws, queue.Instances, queue.ProgramChanges, queue.MaterialChanges, queue.TextureBinds, queue.VertexArrayChanges, queue.LightingChanges, queue.TransformUploads);
+	printf("[STATS] Triangles - %u, by LOD:", queue.Triangles);
+	for (int lod = 0; lod < MAX_LODS; lod++) {
+		printf(" %u", queue.LodTriangles[lod]);
+	}
+	printf("\n");
+}
+
+void Game::CalculateCamera() {
+	CameraRot += glm::vec3(Mouse.y, -Mouse.x, 0) * dt * MOUSE_SENS;
+	if (CameraRot.x > 89.0f)  CameraRot.x = 89.0f;
+	if (CameraRot.x < -89.0f) CameraRot.x = -89.0f;
+
+	glm::vec3 direction = FORWARD;
+	glm::quat rot = glm::quat(glm::radians(CameraRot));
+	direction = glm::rotate(rot, direction);
+	direction = glm::normalize(direction);
+
+	// Rotation without X axis, for use with movement
+	glm::quat rotNoX = glm::quat(glm::radians(glm::vec3(
+		0,
+		CameraRot.y,
+		CameraRot.z
+	)));
+
+	glm::vec3 moveVector(0,0,0);
+	if (Keys[GLFW_KEY_W])
+		moveVector += FORWARD;
+	if (Keys[GLFW_KEY_A])
+		moveVector -= RIGHT;
+	if (Keys[GLFW_KEY_S])
+		moveVector -= FORWARD;
+	if (Keys[GLFW_KEY_D])
+		moveVector += RIGHT;
+	if (Keys[GLFW_KEY_SPACE])
+		moveVector += UP;
+	if (Keys[GLFW_KEY_LEFT_CONTROL])
+		moveVector -= UP;
+	moveVector *= dt * MOVE_SPEED;
+	CameraPos += glm::rotate(rotNoX, moveVector);
+
+	CurrentView = glm::mat4(1.0);
+	CurrentView = glm::lookAt(CameraPos, CameraPos + direction, UP);
+}
+
+void Game::Draw()
+{
+	Shader::ResetStats();
+
+	// Only transforms that changed since last frame are rebuilt
+	{
+		PROFILE_ZONE("Transforms");
+		Model::Transforms().Update(*Jobs);
+	}
+
+	// Cull every object's bounding sphere in one batch before anything is submitted.
+	// Picking up model data goes through the resource manager so stays on this thread,
+	// the bounds and the culling itself are split across the job system.
+	{
+		PROFILE_ZONE("Culling");
+		Culling.Begin(CurrentProjection * CurrentView);
+		cullCandidates.clear();
+		for (auto object : objects) {
+			// Objects without model data have nothing to draw
+			if (object->IsReady())
+				cullCandidates.push_back(object);
+		}
+		Culling.Resize(cullCandidates.size());
+		Jobs->ParallelFor(cullCandidates.size(), OBJECT_GRAIN, [&](size_t begin, size_t end) {
+			for (size_t i=begin; i<end; i++) {
+				BoundingSphere sphere;
+				cullCandidates[i]->GetWorldSphere(sphere);
+				Culling.Set((GLuint)i, sphere);
+			}
+		});
+		Culling.Run(*Jobs);
+		visibleObjects.clear();
+		for (GLuint i=0; i<cullCandidates.size(); i++) {
+			if (Culling.IsVisible(i))
+				visibleObjects.push_back(cullCandidates[i]);
+		}
+	}
+
+	// Lamps light what is around them whether or not their own model is on screen
+	{
+		PROFILE_ZONE("Lights");
+		PROFILE_GPU_ZONE("Lights upload");
+		Lights.Begin(CurrentView, CurrentProjection, NEAR_PLANE, FAR_PLANE);
+		for (auto object : cullCandidates) {
+			object->PrepareLighting(Lights);
+		}
+		Lights.Build(*Jobs);
+		Lights.Upload();
+		Lights.Bind();
+	}
+
+	// One lighting block for the whole frame, the lights themselves are found through the clusters
+	LightingInfo frameLighting = {};
+	frameLighting.AmbientColor = AMBIENT_COLOR;
+	frameLighting.ViewPos = glm::vec4(CameraPos, 1);
+	Lights.Fill(frameLighting);
+	Lighting.BeginFrame();
+	GLuint lightingSlot = Lighting.Submit(frameLighting);
+	Lighting.Upload();
+
+	{
+		PROFILE_ZONE("Submit");
+		Queue.Begin(CurrentProjection, CurrentView, CameraPos, FAR_PLANE);
+		for (auto object : visibleObjects) {
+			object->Submit(Queue, Culling, lightingSlot);
+		}
+	}
+	{
+		PROFILE_ZONE("Queue flush");
+		PROFILE_GPU_ZONE("Scene");
+		Queue.Flush(Lighting);
+	}
+}
+
+void Game::ResizeEvent(GLfloat width, GLfloat height)
+{
+	Width = width;
+	Height = height;
 }
\ No newline at end of file
@@ -1,35 +1,65 @@
-#pragma once
-
-#include <GL\glew.h>
-#include <GLFW\glfw3.h>
-#include <glm/glm.hpp>
-#include <glm/gtc/quaternion.hpp>
-
-#include "Code/LightingInfo.h"
-
-class Game
-{
-public:
-	GLboolean Keys[1024];
-	GLuint Width, Height;
-	glm::vec2 Mouse;
-
-	Game(GLuint width, GLuint height);
-	~Game();
-
-	void Init();
-	void Update(GLfloat dt);
-	void Draw();
-	void ResizeEvent(GLfloat width, GLfloat height);
-private:
-	void CalculateCamera();
-	void CalculateLighting();
-
-	float dt;
-
-	glm::vec3 CameraPos;
-	glm::vec3 CameraRot;
-	//glm::tquat<float> CameraRot;
-	glm::highp_mat4 CurrentProjection;
-	glm::highp_mat4 CurrentView;
+#pragma once
+
+#include <GL\glew.h>
+#include <GLFW\glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "Code/LightingBuffer.h"
+#include "Code/LightClusters.h"
+#include "Code/RenderQueue.h"
+#include "Code/Culling.h"
+#include "Code/FramePacer.h"
+#include "Code/JobSystem.h"
+
+class Model;
+
+class Game
+{
+public:
+	GLboolean Keys[1024];
+	GLuint Width, Height;
+	glm::vec2 Mouse;
+	// Runs the main loop's frame timing
+	FramePacer Pacer;
+
+	Game(GLuint width, GLuint height);
+	~Game();
+
+	void Init();
+	// Deletes every object. Call before the GL context goes away, the
+	// destructor only catches what is left over.
+	void Shutdown();
+	void Update(GLfloat dt);
+	void Draw();
+	void ResizeEvent(GLfloat width, GLfloat height);
+private:
+	void CalculateCamera();
+	void CalculateLighting();
+	// Dumps the last frame's renderer counters to the console (F3)
+	void PrintStats();
+
+	float dt;
+	LightingBuffer Lighting;
+	// Every lamp in the scene, sorted into the view's clusters
+	LightClusters Lights;
+	RenderQueue Queue;
+	Culler Culling;
+	// Fans per-object work out over every core, GL calls stay on this thread.
+	// Created in Init so a global Game doesn't start threads during static init.
+	std::unique_ptr<JobSystem> Jobs;
+	// Models handed to the culler, and those that survived it
+	std::vector<Model*> cullCandidates;
+	std::vector<Model*> visibleObjects;
+	bool statsKeyHeld = false;
+	bool captureKeyHeld = false;
+
+	glm::vec3 CameraPos;
+	glm::vec3 CameraRot;
+	//glm::tquat<float> CameraRot;
+	glm::highp_mat4 CurrentProjection;
+	glm::highp_mat4 CurrentView;
 };
\ No newline at end of file
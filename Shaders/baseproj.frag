@@ -1,8 +1,8 @@
-#version 330 core
-out vec4 FragColor;
-
-uniform vec4 color;
-
-void main() {
-	FragColor = color;
+#version 330 core
+out vec4 FragColor;
+
+uniform vec4 color;
+
+void main() {
+	FragColor = color;
 }
\ No newline at end of file
@@ -1,9 +1,9 @@
-#version 330 core
-
-in vec3 aPos;
-
-uniform mat4 pvm;
-
-void main() {
-	gl_Position = pvm * vec4(aPos, 1);
+#version 330 core
+
+in vec3 aPos;
+
+uniform mat4 pvm;
+
+void main() {
+	gl_Position = pvm * vec4(aPos, 1);
 }
\ No newline at end of file
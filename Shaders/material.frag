@@ -1,55 +1,95 @@
-#version 330 core
-out vec4 FragColor;
-
-in vec3 Normal;
-in vec2 TexCoord;
-in vec3 FragPos;
-
-uniform vec4 color;
-
-#define MAX_LIGHTS 8
-#define MAX_TEXTURES 8
-
-uniform bool lightActive[MAX_LIGHTS];
-uniform vec4 lightColor[MAX_LIGHTS];
-uniform vec3 lightPos[MAX_LIGHTS];
-uniform float specularStrength[MAX_LIGHTS];
-uniform vec4 ambientColor;
-uniform float ambientStrength;
-uniform vec3 viewPos;
-
-uniform bool diffuseActive[MAX_TEXTURES];
-uniform bool specularActive[MAX_TEXTURES];
-
-uniform sampler2D texture_diffuse[MAX_TEXTURES];
-uniform sampler2D texture_specular[MAX_TEXTURES];
-
-void main() {
-	vec3 norm = normalize(Normal);
-
-	vec3 ambient = ambientStrength * vec3(ambientColor);
-	vec3 lighting = ambient;
-
-	for (int i=0; i<MAX_LIGHTS; i++) {
-		if (!lightActive[i]) {
-			continue;
-		}
-
-		vec3 lightDir = normalize(lightPos[i] - FragPos);
-
-		float diff = max(dot(norm, lightDir), 0.0);
-		vec3 diffuse = diff * vec3(lightColor[i]);
-		lighting += diffuse;
-
-		vec3 viewDir = normalize(viewPos - FragPos);
-		vec3 reflectDir = reflect(-lightDir, norm);
-		float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-		vec3 specular = specularStrength[i] * spec * vec3(lightColor[i]);
-		lighting += specular;
-	}
-
-	if (diffuseActive[0])
-		FragColor = vec4(lighting, 1) * texture(texture_diffuse[0], TexCoord);
-	else
-		FragColor = vec4(lighting, 1) * color;
+#version 330 core
+// Compiled per feature set, see Shader.h: DIFFUSE_MAP, SPECULAR_MAP
+#if defined(DIFFUSE_MAP) || defined(SPECULAR_MAP)
+#define TEXTURED
+#endif
+
+out vec4 FragColor;
+
+in vec3 Normal;
+#ifdef TEXTURED
+in vec2 TexCoord;
+#endif
+in vec3 FragPos;
+
+#ifdef DIFFUSE_MAP
+uniform sampler2D diffuseMap;
+#else
+uniform vec4 color;
+#endif
+#ifdef SPECULAR_MAP
+uniform sampler2D specularMap;
+#endif
+
+// Must match LightClusters.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+// Uploaded once per frame by LightingBuffer, see LightingInfo.h
+layout (std140) uniform Lighting {
+	vec4 ambientColor; // rgb colour, a strength
+	vec4 viewPos;
+	vec4 viewport; // xy origin, zw size in pixels
+	vec4 clusterDepth; // near plane, far plane, depth slice scale and bias
+};
+
+// Two texels per light: xyz position and range, rgb colour and specular strength
+uniform samplerBuffer lightData;
+// One entry per cluster (offset in the low 24 bits, count in the high 8), then the light indices
+uniform usamplerBuffer clusterItems;
+
+int findCluster() {
+	float near = clusterDepth.x;
+	float far = clusterDepth.y;
+	float depth = 2.0 * near * far / (far + near - (gl_FragCoord.z * 2.0 - 1.0) * (far - near));
+	ivec2 tile = ivec2((gl_FragCoord.xy - viewport.xy) / viewport.zw * vec2(CLUSTER_X, CLUSTER_Y));
+	tile = clamp(tile, ivec2(0), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+	int slice = clamp(int(floor(log(depth) * clusterDepth.z + clusterDepth.w)), 0, CLUSTER_Z - 1);
+	return tile.x + tile.y * CLUSTER_X + slice * CLUSTER_X * CLUSTER_Y;
+}
+
+void main() {
+	vec3 norm = normalize(Normal);
+	vec3 viewDir = normalize(vec3(viewPos) - FragPos);
+
+	vec3 ambient = ambientColor.a * vec3(ambientColor);
+	vec3 lighting = ambient;
+#ifdef SPECULAR_MAP
+	float specularScale = texture(specularMap, TexCoord).r;
+#else
+	float specularScale = 1.0;
+#endif
+
+	uint cluster = texelFetch(clusterItems, findCluster()).r;
+	int first = int(cluster & 0xFFFFFFu);
+	int count = int(cluster >> 24);
+	for (int i=0; i<count; i++) {
+		int light = int(texelFetch(clusterItems, first + i).r);
+		vec4 positionRange = texelFetch(lightData, light * 2);
+		vec4 colorSpecular = texelFetch(lightData, light * 2 + 1);
+
+		vec3 toLight = positionRange.xyz - FragPos;
+		float distance = length(toLight);
+		// Smooth falloff reaching exactly zero at the light's range
+		float falloff = clamp(1.0 - distance * distance / (positionRange.w * positionRange.w), 0.0, 1.0);
+		falloff *= falloff;
+		if (falloff == 0.0)
+			continue;
+		vec3 lightDir = toLight / distance;
+
+		float diff = max(dot(norm, lightDir), 0.0);
+		vec3 diffuse = diff * colorSpecular.rgb;
+
+		vec3 reflectDir = reflect(-lightDir, norm);
+		float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+		vec3 specular = colorSpecular.a * specularScale * spec * colorSpecular.rgb;
+		lighting += (diffuse + specular) * falloff;
+	}
+
+#ifdef DIFFUSE_MAP
+	FragColor = vec4(lighting, 1) * texture(diffuseMap, TexCoord);
+#else
+	FragColor = vec4(lighting, 1) * color;
+#endif
 }
\ No newline at end of file
@@ -1,19 +1,46 @@
-#version 330 core
-
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoord;
-
-out vec3 Normal;
-out vec2 TexCoord;
-out vec3 FragPos;
-
-uniform mat4 pv;
-uniform mat4 model;
-
-void main() {
-	gl_Position = pv * model * vec4(aPos, 1);
-    Normal = mat3(transpose(inverse(model))) *aNormal;
-    TexCoord = aTexCoord;
-    FragPos = vec3(model * vec4(aPos, 1.0));
+#version 330 core
+// Compiled per feature set, see Shader.h: INSTANCED, DIFFUSE_MAP, SPECULAR_MAP
+#if defined(DIFFUSE_MAP) || defined(SPECULAR_MAP)
+#define TEXTURED
+#endif
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+#ifdef TEXTURED
+layout (location = 2) in vec2 aTexCoord;
+#endif
+
+#ifdef INSTANCED
+// Per-instance attributes, see InstanceData in RenderQueue.h
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
+#else
+uniform mat4 model;
+// Inverse transpose of the model matrix, built on the CPU
+uniform mat3 normalMatrix;
+#endif
+
+out vec3 Normal;
+#ifdef TEXTURED
+out vec2 TexCoord;
+#endif
+out vec3 FragPos;
+
+uniform mat4 pv;
+// Packed meshes store positions as unorm16 across their bounding box
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+void main() {
+#ifdef INSTANCED
+    mat4 model = aModel;
+    mat3 normalMatrix = aNormalMatrix;
+#endif
+    vec3 position = aPos * positionScale + positionOffset;
+    FragPos = vec3(model * vec4(position, 1.0));
+	gl_Position = pv * vec4(FragPos, 1);
+    Normal = normalMatrix * aNormal;
+#ifdef TEXTURED
+    TexCoord = aTexCoord;
+#endif
 }
\ No newline at end of file